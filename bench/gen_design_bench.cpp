@@ -0,0 +1,418 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cxxopts.hpp>
+#include <fmt/base.h>
+#include <functional>
+#include <ios>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "design_config.hpp"
+#include "gen_spef.hpp"
+#include "name_arena.hpp"
+#include "output_buffer.hpp"
+#include "spef.hpp"
+#include "verilog_cells.hpp"
+
+// The allocations of the whole process, counted by the replacements of the
+// global `operator new` below.
+std::atomic<std::uint64_t> num_allocs;
+
+void *operator new(std::size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void *const ptr = std::malloc(std::max<std::size_t>(size, 1))) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t align) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  auto const alignment = static_cast<std::size_t>(align);
+  // `aligned_alloc` wants a multiple of the alignment
+  std::size_t const aligned_size =
+      (std::max<std::size_t>(size, 1) + alignment - 1) / alignment * alignment;
+  if (void *const ptr = std::aligned_alloc(alignment, aligned_size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+// not inlined, since gcc then warns about `free`ing what `operator new`
+// returned
+[[gnu::noinline]] void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+[[gnu::noinline]] void
+operator delete(void *ptr, std::size_t /*size*/) noexcept {
+  std::free(ptr);
+}
+
+[[gnu::noinline]] void
+operator delete(void *ptr, std::align_val_t /*align*/) noexcept {
+  std::free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(
+    void *ptr,
+    std::size_t /*size*/,
+    std::align_val_t /*align*/) noexcept {
+  std::free(ptr);
+}
+
+// The stream of the `output_buffer`s of the benchmarks, which only counts the
+// bytes, so that the disk doesn't take part in the measurements. It isn't
+// inlined, so that the compiler can't drop what is written to it.
+class null_sink {
+public:
+  std::uint64_t m_bytes{};
+
+  [[gnu::noinline]] void write(char const * /*data*/, std::streamsize size) {
+    m_bytes += static_cast<std::uint64_t>(size);
+  }
+};
+
+// A benchmark is set up once, out of the measurements, and then runs its
+// operation `num_ops` times per call of `m_run`, which returns the number of
+// items (nets, cells, values, ...) the operations processed.
+class benchmark {
+public:
+  std::string m_name;
+  std::function<std::uint64_t(std::uint64_t num_ops)> m_run;
+};
+
+class measurement {
+public:
+  double m_ns_per_op{};
+  double m_items_per_sec{};
+  double m_allocs_per_op{};
+};
+
+// forward declarations
+std::vector<benchmark> make_benchmarks(design_config const &config);
+benchmark bench_write_wires(design_config const &config);
+benchmark bench_write_cells(design_config const &config);
+benchmark bench_gen_block_net_conn_def(design_config const &config);
+benchmark bench_gen_block_net_cap_sec_ground(design_config const &config);
+benchmark bench_gen_block_net_res_sec(design_config const &config);
+benchmark bench_gen_block_net_cap_sec_coupling(design_config const &config);
+benchmark bench_d_net_write(design_config const &config);
+benchmark bench_multivalue_write(design_config const &config);
+measurement measure(benchmark const &bench, std::uint64_t num_ops);
+measurement run_benchmark(
+    benchmark const &bench,
+    std::chrono::duration<double> min_time,
+    std::size_t num_repetitions);
+
+// the block nets of the benchmarks of the SPEF writer, with their
+// connections, and optionally their capacitances and resistances
+class block_nets {
+public:
+  std::pmr::monotonic_buffer_resource m_resource;
+  name_arena m_names;
+  std::vector<d_net> m_nets;
+  coupling_caps m_ccaps;
+
+  block_nets(design_config const &config, bool with_values) {
+    m_nets.reserve(config.num_nets);
+    for (std::size_t net_idx = 0; net_idx < config.num_nets; ++net_idx) {
+      d_net &net = m_nets.emplace_back(d_net::allocator_type(&m_resource));
+      net.m_net_ref = m_names.format("{}{}", config.net_prefix, net_idx);
+      gen_block_net_conn_def(net, net_idx, m_names, ':', config);
+      if (with_values) {
+        gen_block_net_cap_sec_ground(net, net_idx, config);
+        gen_block_net_res_sec(net, net_idx, config);
+      }
+    }
+    if (with_values) {
+      gen_block_net_cap_sec_coupling(m_ccaps, config);
+      for (std::size_t net_idx = 0; net_idx < config.num_nets; ++net_idx) {
+        m_nets[net_idx].add_coupling_caps(net_idx, m_ccaps);
+      }
+    }
+  }
+};
+
+int main(int argc, char const *const *argv) {
+  cxxopts::Options options(
+      "gen_design_bench",
+      "Measure the hot loops of gen_design, writing to a null sink");
+  auto opt_adder = options.add_options();
+  opt_adder(
+      "n,num_nets",
+      "The number of nets of the block the benchmarks work on",
+      cxxopts::value<std::size_t>()->default_value("10000"));
+  opt_adder(
+      "s,seed",
+      "The seed for the random number generator",
+      cxxopts::value<unsigned int>()->default_value("1"));
+  opt_adder(
+      "filter",
+      "Only run the benchmarks whose name contains this string",
+      cxxopts::value<std::string>()->default_value(""));
+  opt_adder(
+      "min_time",
+      "The minimum number of seconds of each repetition",
+      cxxopts::value<double>()->default_value("0.2"));
+  opt_adder(
+      "repetitions",
+      "The number of repetitions of each benchmark, of which the median is "
+      "reported",
+      cxxopts::value<std::size_t>()->default_value("5"));
+  opt_adder("h,help", "Print this help message");
+  auto result = options.parse(argc, argv);
+
+  if (result.count("help") != 0) {
+    fmt::println("{}", options.help());
+    return 0;
+  }
+
+  design_config config;
+  // the first net and the others are generated differently
+  config.num_nets =
+      std::max<std::size_t>(result["num_nets"].as<std::size_t>(), 2);
+  config.seed = result["seed"].as<unsigned int>();
+  config.init_rand();
+  std::string const filter = result["filter"].as<std::string>();
+  std::chrono::duration<double> const min_time(result["min_time"].as<double>());
+  std::size_t const num_repetitions =
+      std::max<std::size_t>(result["repetitions"].as<std::size_t>(), 1);
+
+  fmt::println(
+      "{:<36} {:>12} {:>14} {:>12}",
+      "benchmark",
+      "ns/op",
+      "items/s",
+      "allocs/op");
+  for (benchmark const &bench : make_benchmarks(config)) {
+    if (bench.m_name.find(filter) == std::string::npos) {
+      continue;
+    }
+    measurement const m = run_benchmark(bench, min_time, num_repetitions);
+    fmt::println(
+        "{:<36} {:>12.1f} {:>14.4g} {:>12.2f}",
+        bench.m_name,
+        m.m_ns_per_op,
+        m.m_items_per_sec,
+        m.m_allocs_per_op);
+  }
+  return 0;
+}
+
+std::vector<benchmark> make_benchmarks(design_config const &config) {
+  design_config quantized = config;
+  quantized.quantize_caps = true;
+  benchmark quantized_multivalue = bench_multivalue_write(quantized);
+  quantized_multivalue.m_name += "/quantized";
+
+  std::vector<benchmark> benchmarks;
+  benchmarks.push_back(bench_write_wires(config));
+  benchmarks.push_back(bench_write_cells(config));
+  benchmarks.push_back(bench_gen_block_net_conn_def(config));
+  benchmarks.push_back(bench_gen_block_net_cap_sec_ground(config));
+  benchmarks.push_back(bench_gen_block_net_res_sec(config));
+  benchmarks.push_back(bench_gen_block_net_cap_sec_coupling(config));
+  benchmarks.push_back(bench_d_net_write(config));
+  benchmarks.push_back(bench_multivalue_write(config));
+  benchmarks.push_back(std::move(quantized_multivalue));
+  return benchmarks;
+}
+
+// Calibrates the number of operations of a repetition on `min_time`, and
+// returns the repetition of median time. The number of allocations of an
+// operation doesn't depend on the timing, so any repetition has it.
+measurement run_benchmark(
+    benchmark const &bench,
+    std::chrono::duration<double> min_time,
+    std::size_t num_repetitions) {
+  std::uint64_t num_ops = 1;
+  while (true) {
+    measurement const m = measure(bench, num_ops);
+    double const sec = m.m_ns_per_op * static_cast<double>(num_ops) * 1e-9;
+    if (sec >= min_time.count()) {
+      break;
+    }
+    // aim a little past `min_time`, but grow at most 10x at a time, since the
+    // first operations may be slower than the next ones
+    double const factor =
+        sec <= 0 ? 10 : std::min(10.0, 1.2 * min_time.count() / sec);
+    num_ops = std::max(
+        num_ops + 1,
+        static_cast<std::uint64_t>(static_cast<double>(num_ops) * factor));
+  }
+
+  std::vector<measurement> repetitions;
+  for (std::size_t rep_idx = 0; rep_idx < num_repetitions; ++rep_idx) {
+    repetitions.push_back(measure(bench, num_ops));
+  }
+  auto const median = std::ranges::next(
+      repetitions.begin(),
+      static_cast<std::ptrdiff_t>(repetitions.size() / 2));
+  std::ranges::nth_element(repetitions, median, {}, &measurement::m_ns_per_op);
+  return *median;
+}
+
+measurement measure(benchmark const &bench, std::uint64_t num_ops) {
+  std::uint64_t const allocs_before = num_allocs.load();
+  auto const start = std::chrono::steady_clock::now();
+  std::uint64_t const num_items = bench.m_run(num_ops);
+  std::chrono::duration<double> const elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::uint64_t const allocs = num_allocs.load() - allocs_before;
+
+  auto const ops = static_cast<double>(num_ops);
+  return {
+      elapsed.count() * 1e9 / ops,
+      elapsed.count() > 0 ? static_cast<double>(num_items) / elapsed.count()
+                          : 0,
+      static_cast<double>(allocs) / ops};
+}
+
+// one operation writes the `wire` declaration of all the nets, through a
+// `wrapped_writer`, and the items are the nets
+benchmark bench_write_wires(design_config const &config) {
+  auto sink = std::make_shared<null_sink>();
+  auto out = std::make_shared<output_buffer<null_sink>>(*sink);
+  return {"write_wires", [config, sink, out](std::uint64_t num_ops) {
+            for (std::uint64_t op_idx = 0; op_idx < num_ops; ++op_idx) {
+              write_wires(*out, config);
+            }
+            return num_ops * config.num_nets;
+          }};
+}
+
+// one operation writes the lines of all the cells, and the items are the
+// cells
+benchmark bench_write_cells(design_config const &config) {
+  auto sink = std::make_shared<null_sink>();
+  auto out = std::make_shared<output_buffer<null_sink>>(*sink);
+  auto parts = std::make_shared<cell_line_parts>(config);
+  return {"write_cells", [config, sink, out, parts](std::uint64_t num_ops) {
+            for (std::uint64_t op_idx = 0; op_idx < num_ops; ++op_idx) {
+              write_cells(*out, config, *parts, 0, 2 * config.num_nets);
+            }
+            return num_ops * 2 * config.num_nets;
+          }};
+}
+
+// one operation generates the connections of a net, into a net and names that
+// are cleared first, and the items are the nets
+benchmark bench_gen_block_net_conn_def(design_config const &config) {
+  auto resource = std::make_shared<std::pmr::monotonic_buffer_resource>();
+  auto names = std::make_shared<name_arena>();
+  auto net = std::make_shared<d_net>(d_net::allocator_type(resource.get()));
+  return {
+      "gen_block_net_conn_def",
+      [config, resource, names, net](std::uint64_t num_ops) {
+        for (std::uint64_t op_idx = 0; op_idx < num_ops; ++op_idx) {
+          net->clear();
+          names->clear();
+          gen_block_net_conn_def(
+              *net,
+              op_idx % config.num_nets,
+              *names,
+              ':',
+              config);
+        }
+        return num_ops;
+      }};
+}
+
+// one operation generates the ground capacitances of a net, and the items are
+// the nets
+benchmark bench_gen_block_net_cap_sec_ground(design_config const &config) {
+  auto nets = std::make_shared<block_nets>(config, false);
+  return {
+      "gen_block_net_cap_sec_ground",
+      [config, nets](std::uint64_t num_ops) {
+        for (std::uint64_t op_idx = 0; op_idx < num_ops; ++op_idx) {
+          std::size_t const net_idx = op_idx % config.num_nets;
+          d_net &net = nets->m_nets[net_idx];
+          net.m_cap_sec.clear();
+          gen_block_net_cap_sec_ground(net, net_idx, config);
+        }
+        return num_ops;
+      }};
+}
+
+// one operation generates the resistances of a net, and the items are the
+// nets
+benchmark bench_gen_block_net_res_sec(design_config const &config) {
+  auto nets = std::make_shared<block_nets>(config, false);
+  return {
+      "gen_block_net_res_sec",
+      [config, nets](std::uint64_t num_ops) {
+        for (std::uint64_t op_idx = 0; op_idx < num_ops; ++op_idx) {
+          std::size_t const net_idx = op_idx % config.num_nets;
+          d_net &net = nets->m_nets[net_idx];
+          net.m_res_sec.m_ress.clear();
+          gen_block_net_res_sec(net, net_idx, config);
+        }
+        return num_ops;
+      }};
+}
+
+// one operation generates the coupling capacitances of all the nets, and the
+// items are the coupling capacitances
+benchmark bench_gen_block_net_cap_sec_coupling(design_config const &config) {
+  return {
+      "gen_block_net_cap_sec_coupling",
+      [config](std::uint64_t num_ops) {
+        std::uint64_t num_ccaps = 0;
+        for (std::uint64_t op_idx = 0; op_idx < num_ops; ++op_idx) {
+          coupling_caps ccaps;
+          gen_block_net_cap_sec_coupling(ccaps, config);
+          num_ccaps += ccaps.m_caps.size();
+        }
+        return num_ccaps;
+      }};
+}
+
+// one operation writes a whole net, with its coupling capacitances, and the
+// items are the nets
+benchmark bench_d_net_write(design_config const &config) {
+  auto nets = std::make_shared<block_nets>(config, true);
+  auto sink = std::make_shared<null_sink>();
+  auto out = std::make_shared<output_buffer<null_sink>>(*sink);
+  return {
+      "d_net::write",
+      [config, nets, sink, out](std::uint64_t num_ops) {
+        auto const node_name = [&nets](std::size_t net_idx,
+                                       std::size_t node_idx) {
+          return nets->m_nets[net_idx].m_conn_sec.node_name(node_idx);
+        };
+        for (std::uint64_t op_idx = 0; op_idx < num_ops; ++op_idx) {
+          std::size_t const net_idx = op_idx % config.num_nets;
+          nets->m_nets[net_idx].write(*out, net_idx, nets->m_ccaps, node_name);
+        }
+        return num_ops;
+      }};
+}
+
+// one operation writes a capacitance drawn like the ones of the nets, and the
+// items are the capacitances
+benchmark bench_multivalue_write(design_config const &config) {
+  static constexpr std::size_t NUM_VALUES{std::size_t{1} << 12};
+  auto values = std::make_shared<std::vector<par_value>>();
+  values->reserve(NUM_VALUES);
+  for (std::size_t value_idx = 0; value_idx < NUM_VALUES; ++value_idx) {
+    values->push_back(par_value{config.rand_cap()});
+  }
+  auto sink = std::make_shared<null_sink>();
+  auto out = std::make_shared<output_buffer<null_sink>>(*sink);
+  return {
+      "multivalue::write",
+      [values, sink, out](std::uint64_t num_ops) {
+        for (std::uint64_t op_idx = 0; op_idx < num_ops; ++op_idx) {
+          (*values)[op_idx % NUM_VALUES].write(*out);
+        }
+        return num_ops;
+      }};
+}
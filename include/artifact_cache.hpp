@@ -0,0 +1,64 @@
+#ifndef ARTIFACT_CACHE_HPP
+#define ARTIFACT_CACHE_HPP
+
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+
+#include "design_config.hpp"
+
+// The keys of the output files in the cache: the parts of the config that the
+// bytes of each file depend on, as text, and nothing else, so that e.g. a new
+// `num_blocks` still finds the block files. top.spef also depends on the
+// block in sequential mode, since it draws from the generator after
+// block.spef.
+std::string block_verilog_cache_key(design_config const &config);
+std::string top_verilog_cache_key(design_config const &config);
+std::string block_spef_cache_key(design_config const &config);
+std::string top_spef_cache_key(design_config const &config);
+
+// A directory of output files from earlier runs, addressed by a hash of their
+// keys: <dir>/<hash>/file is the file, and <dir>/<hash>/entry holds its key,
+// to tell hash collisions apart, the size of its content, and the generator
+// the next file starts from.
+// The files are shared with the output files as reflinks where the file
+// system supports them, as hard links otherwise, and as copies across file
+// systems.
+class artifact_cache {
+public:
+  // what the cache has of a file
+  class entry {
+  public:
+    std::uint64_t m_size{};
+    // the size of its content, before compression
+    std::uint64_t m_uncompressed_size{};
+    // the random number generator when the file was finished
+    std::mt19937_64 m_end_gen;
+  };
+
+  // creates `dir` if it doesn't exist yet
+  explicit artifact_cache(std::string dir);
+
+  // Shares the file of `key` with `path`, replacing what is there, if the
+  // cache has it.
+  std::optional<entry>
+  fetch(std::string const &key, std::string const &path) const;
+
+  // Adds the file at `path`, just written, as the file of `key`, with the
+  // size of its content `uncompressed_size` and the generator `end_gen` the
+  // next file starts from. Another run may add the same file at the same time,
+  // and only one of them is kept.
+  void store(
+      std::string const &key,
+      std::string const &path,
+      std::uint64_t uncompressed_size,
+      std::mt19937_64 const &end_gen = std::mt19937_64()) const;
+
+private:
+  std::string m_dir;
+
+  [[nodiscard]] std::string entry_dir(std::string const &key) const;
+};
+
+#endif // ARTIFACT_CACHE_HPP
@@ -0,0 +1,119 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+
+#include "design_config.hpp"
+#include "output_buffer.hpp"
+#include "output_sink.hpp"
+
+// A point of an output file where everything before it is on the disk, which
+// --resume truncates the file to before carrying on from there. It is saved
+// next to the file, as <file>.checkpoint, along with the parts of the config
+// that the content of the file depends on, so that a run can't resume from the
+// checkpoint of another config.
+class checkpoint {
+public:
+  // the number of nets (or cells of block.v) before the point
+  std::size_t m_next_idx{};
+  // the size of the file up to the point
+  std::uint64_t m_offset{};
+  // whether the whole file is written, and the point is its end
+  bool m_done{};
+  // the random number generator when the file was started, and, once it is
+  // done, when it was finished, since the SPEF files draw from the same
+  // generator one after the other in sequential mode
+  std::mt19937_64 m_start_gen;
+  std::mt19937_64 m_end_gen;
+};
+
+// "<path>.checkpoint"
+std::string checkpoint_path(std::string const &path);
+
+// Reads the checkpoint of the file at `path`, if there is one. Throws
+// `std::runtime_error` if it is invalid, or if it is from another config.
+std::optional<checkpoint>
+read_checkpoint(std::string const &path, design_config const &config);
+
+// Saves the checkpoints of an output file, at most every
+// `config.checkpoint_interval` seconds, and, with `config.resume`, reads the
+// one the file resumes from.
+class checkpointer {
+public:
+  checkpointer(std::string path, design_config const &config);
+
+  // the checkpoint the file resumes from, if any
+  [[nodiscard]] std::optional<checkpoint> const &resumed() const {
+    return m_resumed;
+  }
+
+  // whether checkpoints are saved at all
+  [[nodiscard]] bool enabled() const {
+    return m_enabled;
+  }
+
+  // whether a checkpoint is due, which only looks at the clock every so
+  // often, so that it can be called after each net
+  bool due() {
+    if (!m_enabled || ++m_num_calls % CLOCK_PERIOD != 0) {
+      return false;
+    }
+    return std::chrono::steady_clock::now() >= m_next_save;
+  }
+
+  // sets the generator the file starts from, saved in every checkpoint
+  void start(std::mt19937_64 const &gen) {
+    m_start_gen = gen;
+  }
+
+  // saves a checkpoint after `next_idx` nets, which end at `offset`
+  void save(std::size_t next_idx, std::uint64_t offset);
+
+  // saves a checkpoint after `next_idx` nets if one is due, once what `out`
+  // holds is on the disk
+  void save_if_due(
+      std::size_t next_idx,
+      output_buffer<output_sink> &out,
+      output_sink &sink) {
+    if (due()) {
+      out.flush();
+      save(next_idx, sink.sync());
+    }
+  }
+
+  // saves the checkpoint of the whole file, which ends at `offset`, with the
+  // generator `end_gen` the next file starts from, if checkpoints are enabled
+  void finish(
+      std::uint64_t offset,
+      std::mt19937_64 const &end_gen = std::mt19937_64());
+
+  // same, once what `out` holds is on the disk
+  void finish(
+      output_buffer<output_sink> &out,
+      output_sink &sink,
+      std::mt19937_64 const &end_gen = std::mt19937_64()) {
+    if (m_enabled) {
+      out.flush();
+      finish(sink.sync(), end_gen);
+    }
+  }
+
+private:
+  static constexpr std::uint64_t CLOCK_PERIOD{1024};
+
+  std::string m_path;
+  design_config const &m_config;
+  bool m_enabled;
+  std::optional<checkpoint> m_resumed;
+  std::mt19937_64 m_start_gen;
+  std::uint64_t m_num_calls{};
+  std::chrono::steady_clock::time_point m_next_save;
+
+  void write(checkpoint const &c);
+};
+
+#endif // CHECKPOINT_HPP
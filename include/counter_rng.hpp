@@ -0,0 +1,79 @@
+#ifndef COUNTER_RNG_HPP
+#define COUNTER_RNG_HPP
+
+#include <algorithm>
+#include <cstdint>
+
+// the files that draw random numbers
+enum class rand_file : std::uint8_t { BLOCK_SPEF, TOP_SPEF };
+
+// what a random number is used for
+enum class rand_field : std::uint8_t {
+  GROUND_CAP,
+  RES,
+  COUPLING_NET,
+  COUPLING_NODE1,
+  COUPLING_NODE2,
+  COUPLING_CAP
+};
+
+// The position of a random number in the design: the `m_idx`-th number of
+// kind `m_field` of net `m_net_idx` of `m_file`.
+class rand_key {
+public:
+  rand_file m_file;
+  rand_field m_field;
+  std::uint64_t m_net_idx;
+  std::uint64_t m_idx;
+};
+
+// A stateless random number generator: the number at a `rand_key` is a hash of
+// the seed and of the key, so it doesn't depend on which numbers were drawn
+// before it, or by which thread.
+class counter_rng {
+public:
+  explicit counter_rng(std::uint64_t seed = 0) : m_seed(seed) {}
+
+  [[nodiscard]] std::uint64_t operator()(rand_key const &key) const {
+    std::uint64_t hash = mix(m_seed);
+    hash = mix(
+        hash
+        ^ (static_cast<std::uint64_t>(key.m_file) << 8
+           | static_cast<std::uint64_t>(key.m_field)));
+    hash = mix(hash ^ key.m_net_idx);
+    return mix(hash ^ key.m_idx);
+  }
+
+  // a number uniformly distributed in [min_val, max_val)
+  [[nodiscard]] double
+  uniform(rand_key const &key, double min_val, double max_val) const {
+    return min_val + unit((*this)(key)) * (max_val - min_val);
+  }
+
+  // an index uniformly distributed in [0, num_idxs)
+  [[nodiscard]] std::size_t
+  index(rand_key const &key, std::size_t num_idxs) const {
+    auto const idx = static_cast<std::size_t>(
+        unit((*this)(key)) * static_cast<double>(num_idxs));
+    // guard against rounding up to `num_idxs`
+    return std::min(idx, num_idxs - 1);
+  }
+
+private:
+  std::uint64_t m_seed;
+
+  // the SplitMix64 finalizer
+  static std::uint64_t mix(std::uint64_t val) {
+    val += 0x9e37'79b9'7f4a'7c15;
+    val = (val ^ (val >> 30)) * 0xbf58'476d'1ce4'e5b9;
+    val = (val ^ (val >> 27)) * 0x94d0'49bb'1331'11eb;
+    return val ^ (val >> 31);
+  }
+
+  // maps the top 53 bits to [0, 1)
+  static double unit(std::uint64_t val) {
+    return static_cast<double>(val >> 11) * 0x1p-53;
+  }
+};
+
+#endif // COUNTER_RNG_HPP
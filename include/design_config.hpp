@@ -1,10 +1,18 @@
 #ifndef DESIGN_CONFIG_HPP
 #define DESIGN_CONFIG_HPP
 
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <optional>
 #include <string>
 #include <random>
 #include <fmt/base.h>
 
+#include "counter_rng.hpp"
+
 // default config values
 
 // by default the design will have `num_blocks * num_nets` nets by the end, and
@@ -26,12 +34,37 @@ static constexpr std::string LIB_LEAF_CELL_D_PIN{"D"};
 static constexpr double MIN_CAP_VAL{1.0};
 static constexpr double MAX_CAP_VAL{5.0};
 static constexpr std::size_t MIN_NUM_CCAPS{5};
+static constexpr std::size_t NUM_THREADS{1};
+
+// how the random numbers are drawn
+enum class rng_mode {
+  // from a single `mt19937_64`, so each number depends on the order of the
+  // draws, and the nets must be generated one after the other
+  SEQUENTIAL,
+  // from a `counter_rng`, so each number depends only on its place in the
+  // design, and the nets can be generated in any order, and in parallel
+  COUNTER
+};
+
+// how the output files are compressed
+enum class output_codec {
+  NONE,
+  // ".gz" files, compressed by zlib, in blocks on `compress_threads` threads
+  // when there are several
+  GZIP,
+  // ".zst" files, compressed by libzstd in `compress_threads` worker threads
+  ZSTD
+};
 
 class design_config {
 public:
   unsigned int seed{};
   mutable std::mt19937_64 gen;
   mutable std::uniform_real_distribution<double> cap_dist;
+  // the capacitances in tenths, when they are quantized
+  mutable std::uniform_int_distribution<std::int64_t> tenths_dist;
+  rng_mode rng{rng_mode::SEQUENTIAL};
+  counter_rng counter;
   std::size_t num_nets{NUM_NETS};
   std::size_t num_blocks{NUM_BLOCKS};
   std::size_t num_cols{NUM_COLS};
@@ -48,16 +81,82 @@ public:
   double min_cap_val{MIN_CAP_VAL};
   double max_cap_val{MAX_CAP_VAL};
   std::size_t min_num_ccaps{MIN_NUM_CCAPS};
+  // the number of threads each output file may use
+  std::size_t num_threads{NUM_THREADS};
+  // generate and write the SPEF nets one at a time, instead of building the
+  // whole file in memory first
+  bool stream_spef{};
+  // refer to the nets and instances of the SPEF files by `*<index>` aliases,
+  // declared once in a *NAME_MAP
+  bool name_map{};
+  // draw the capacitances and resistances as whole tenths in
+  // [min_cap_val, max_cap_val], which are written from a precomputed table
+  bool quantize_caps{};
+  // the number of files block.<k>.spef the block SPEF file is split into, by
+  // ranges of nets, which are written in parallel, or 1 for block.spef
+  std::size_t spef_shards{1};
+  // the time of the *DATE of the SPEF files, from `SOURCE_DATE_EPOCH`, so
+  // that the files are reproducible, instead of the current time
+  std::optional<std::time_t> source_date_epoch;
+  output_codec codec{output_codec::NONE};
+  // the compression level, or 0 for the default level of the codec
+  int compress_level{};
+  // the number of threads that compress each file
+  std::size_t compress_threads{1};
+  // write the files asynchronously, from buffers that io_uring (or a thread of
+  // `pwrite` calls) writes out while the next ones are filled
+  bool async_io{};
+  // open the files with O_DIRECT, bypassing the page cache, when `async_io`
+  bool direct_io{};
+  // where each file is written, instead of its default name in the current
+  // directory: a path, e.g. of a named pipe, or "-" for stdout
+  std::string block_verilog_path;
+  std::string top_verilog_path;
+  std::string block_spef_path;
+  std::string top_spef_path;
+  // how often each file saves a checkpoint, a point up to which it is on the
+  // disk, next to it, or 0 for none
+  std::chrono::seconds checkpoint_interval{};
+  // carry on from the checkpoints of an interrupted run, instead of starting
+  // over
+  bool resume{};
+  // a directory of the files of earlier runs, by the parts of the config
+  // each one depends on, which are reused instead of generated again, or ""
+  // for none
+  std::string cache_dir;
 
-  void init_rand() {
-    fmt::println("Using seed {}", seed);
+  // prints the seed to `log`, which is stderr when stdout is an output file
+  void init_rand(std::FILE *log = stdout) {
+    fmt::println(log, "Using seed {}", seed);
     gen = std::mt19937_64(seed);
     cap_dist = std::uniform_real_distribution<double>(min_cap_val, max_cap_val);
+    tenths_dist = std::uniform_int_distribution<std::int64_t>(
+        std::llround(min_cap_val * 10),
+        std::llround(max_cap_val * 10));
+    counter = counter_rng(seed);
   }
 
   double rand_cap() const {
+    if (quantize_caps) {
+      return static_cast<double>(tenths_dist(gen)) / 10;
+    }
     return cap_dist(gen);
   }
+
+  // the capacitance at `key` in counter mode, the next one in sequential mode
+  double rand_cap(rand_key const &key) const {
+    if (rng == rng_mode::COUNTER) {
+      if (quantize_caps) {
+        auto const num_tenths =
+            static_cast<std::size_t>(tenths_dist.b() - tenths_dist.a() + 1);
+        auto const tenths = static_cast<std::int64_t>(
+            counter.index(key, num_tenths));
+        return static_cast<double>(tenths_dist.a() + tenths) / 10;
+      }
+      return counter.uniform(key, min_cap_val, max_cap_val);
+    }
+    return rand_cap();
+  }
 };
 
 #endif  // DESIGN_CONFIG_HPP
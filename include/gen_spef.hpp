@@ -2,8 +2,63 @@
 #define GEN_SPEF_HPP
 
 #include "design_config.hpp"
+#include "progress.hpp"
+#include "run_stats.hpp"
+#include "spef.hpp"
 
-void write_block_spef(design_config const &config);
-void write_top_spef(design_config const &config);
+void write_block_spef(
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats);
+void write_top_spef(
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats);
+
+// The generators of the sections of net `net_idx` of the block SPEF file,
+// which must run in this order, since the capacitances and the resistances are
+// on the nodes of the connections, and of the coupling capacitances between all
+// the nets. They are the hot loops of `write_block_spef`, and are declared here
+// for `gen_design_bench`.
+void gen_block_net_conn_def(
+    d_net &net,
+    std::size_t net_idx,
+    name_arena &names,
+    char pin_delim_ch,
+    design_config const &config);
+void gen_block_net_cap_sec_ground(
+    d_net &net,
+    std::size_t net_idx,
+    design_config const &config);
+void gen_block_net_res_sec(
+    d_net &net,
+    std::size_t net_idx,
+    design_config const &config);
+void gen_block_net_cap_sec_coupling(
+    coupling_caps &ccaps,
+    design_config const &config);
+
+// A prediction of what the functions above produce, computed without
+// generating anything. The parts of the file that don't depend on the random
+// numbers are sized exactly. The coupling capacitances, the node names they
+// pick, and the digits of the `*D_NET` totals are sized by their expected
+// values.
+class spef_estimate {
+public:
+  // the size of the parts of the file that don't depend on the random numbers
+  std::size_t m_fixed_bytes{};
+  // the expected size of the whole file
+  std::size_t m_expected_bytes{};
+  // the expected total number of coupling capacitances
+  double m_num_ccaps{};
+  // the expected number of coupling capacitances on each net, which is never
+  // less than `min_num_ccaps`
+  double m_ccaps_per_net{};
+  // the expected peak memory used by the `SPEF_file` model
+  std::size_t m_model_bytes{};
+};
+
+spef_estimate estimate_block_spef(design_config const &config);
+spef_estimate estimate_top_spef(design_config const &config);
 
 #endif // GEN_SPEF_HPP
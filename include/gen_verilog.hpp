@@ -2,8 +2,21 @@
 #define GEN_VERILOG_HPP
 
 #include "design_config.hpp"
+#include "progress.hpp"
+#include "run_stats.hpp"
 
-void write_block_verilog(design_config const &config);
-void write_top_verilog(design_config const &config);
+void write_block_verilog(
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats);
+void write_top_verilog(
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats);
+
+// the exact sizes, in bytes, of the files written by the functions above,
+// computed without formatting them
+std::size_t block_verilog_size(design_config const &config);
+std::size_t top_verilog_size(design_config const &config);
 
 #endif  // GEN_VERILOG_HPP
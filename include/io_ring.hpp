@@ -0,0 +1,69 @@
+#ifndef IO_RING_HPP
+#define IO_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// A minimal io_uring for asynchronous writes, used through the raw system
+// calls rather than liburing. Writes are queued, and submitted, by `write`,
+// and their results are collected, in any order, by `wait`.
+class io_ring {
+public:
+  // the result of a write
+  class completion {
+  public:
+    // the `user_data` given to `write`
+    std::uint64_t m_user_data{};
+    // the number of bytes written, or `-errno`
+    int m_result{};
+  };
+
+  // Sets up a ring for `num_entries` writes in flight. Throws
+  // `std::system_error` when io_uring isn't available, e.g. ENOSYS on old
+  // kernels, including those before 5.6, which lack IORING_OP_WRITE, or EPERM
+  // where it is disabled.
+  explicit io_ring(unsigned num_entries);
+  ~io_ring();
+
+  io_ring(io_ring const &) = delete;
+  io_ring &operator=(io_ring const &) = delete;
+
+  // Submits the write of `size` bytes of `data` at `offset` in `fd`. `data`
+  // must stay valid until `wait` returns the completion of `user_data`, and
+  // there must be fewer than `num_entries` writes in flight.
+  void write(
+      int fd,
+      char const *data,
+      std::size_t size,
+      std::uint64_t offset,
+      std::uint64_t user_data);
+
+  // waits for the next write to complete
+  completion wait();
+
+private:
+  int m_fd{-1};
+  void *m_sq_ring{};
+  std::size_t m_sq_ring_size{};
+  void *m_cq_ring{};
+  std::size_t m_cq_ring_size{};
+  void *m_sqes{};
+  std::size_t m_sqes_size{};
+
+  // in the submission ring
+  unsigned *m_sq_tail{};
+  unsigned m_sq_mask{};
+  unsigned *m_sq_array{};
+  // in the completion ring
+  unsigned *m_cq_head{};
+  unsigned *m_cq_tail{};
+  unsigned m_cq_mask{};
+  void *m_cqes{};
+
+  // io_uring_enter, retried when interrupted
+  void enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+  // unmaps the rings and closes the ring
+  void release();
+};
+
+#endif // IO_RING_HPP
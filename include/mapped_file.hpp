@@ -0,0 +1,57 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstring>
+#include <ios>
+#include <libassert/assert.hpp>
+#include <span>
+#include <string>
+
+// A file of a known size, mapped in memory for writing. The file is created
+// (or truncated) and fully allocated upfront, so that several threads can fill
+// in disjoint parts of it concurrently.
+class mapped_file {
+public:
+  mapped_file(std::string const &filename, std::size_t size);
+  ~mapped_file();
+
+  mapped_file(mapped_file const &) = delete;
+  mapped_file &operator=(mapped_file const &) = delete;
+
+  [[nodiscard]] std::span<char> data() const {
+    return {m_data, m_size};
+  }
+
+  // waits until what was written to the mapping is on the disk
+  void sync() const;
+
+private:
+  int m_fd{-1};
+  char *m_data{};
+  std::size_t m_size{};
+};
+
+// An `OSTREAM` that fills in a fixed region of memory, e.g. a part of a
+// `mapped_file`.
+class span_sink {
+public:
+  explicit span_sink(std::span<char> span) : m_span(span) {}
+
+  void write(char const *data, std::streamsize size) {
+    auto const usize = static_cast<std::size_t>(size);
+    ASSERT(usize <= m_span.size() - m_pos, "span overflow", m_span.size());
+    std::memcpy(m_span.data() + m_pos, data, usize);
+    m_pos += usize;
+  }
+
+  // whether the whole region has been written
+  [[nodiscard]] bool full() const {
+    return m_pos == m_span.size();
+  }
+
+private:
+  std::span<char> m_span;
+  std::size_t m_pos{};
+};
+
+#endif // MAPPED_FILE_HPP
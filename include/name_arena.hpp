@@ -0,0 +1,102 @@
+#ifndef NAME_ARENA_HPP
+#define NAME_ARENA_HPP
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Stores names back to back in large blocks, which are only freed with the
+// arena (or by `clear`), so the `std::string_view`s it hands out stay valid
+// until then. The model of a SPEF file formats
+// each node name once into an arena, and refers to it everywhere else by view.
+class name_arena {
+public:
+  static constexpr std::size_t BLOCK_SIZE{std::size_t{1} << 16};
+
+  name_arena() = default;
+  name_arena(name_arena const &) = delete;
+  name_arena &operator=(name_arena const &) = delete;
+  name_arena(name_arena &&) = delete;
+  name_arena &operator=(name_arena &&) = delete;
+  ~name_arena() = default;
+
+  std::string_view add(std::string_view name) {
+    char *const data = allocate(name.size());
+    std::ranges::copy(name, data);
+    return {data, name.size()};
+  }
+
+  template <typename... T>
+  std::string_view format(fmt::format_string<T...> fmt, T &&...args) {
+    m_scratch.clear();
+    fmt::format_to(
+        std::back_inserter(m_scratch),
+        fmt,
+        std::forward<T>(args)...);
+    return add({m_scratch.data(), m_scratch.size()});
+  }
+
+  // forgets all the names, but keeps the first block for the next ones
+  void clear() {
+    if (m_blocks.empty()) {
+      return;
+    }
+    m_blocks.resize(1);
+    m_pos = m_blocks.front().m_data.get();
+    m_end = m_pos + m_blocks.front().m_size;
+  }
+
+  // takes over the names of `other`, e.g. to collect the names that several
+  // threads added to arenas of their own
+  void splice(name_arena &&other) {
+    // keep filling our current block, which is the last one
+    auto const pos = m_blocks.empty() ? m_blocks.end() : m_blocks.end() - 1;
+    m_blocks.insert(
+        pos,
+        std::make_move_iterator(other.m_blocks.begin()),
+        std::make_move_iterator(other.m_blocks.end()));
+    other.m_blocks.clear();
+    other.m_pos = nullptr;
+    other.m_end = nullptr;
+  }
+
+  // the memory held by the arena
+  [[nodiscard]] std::size_t capacity() const {
+    std::size_t capacity = 0;
+    for (block const &b : m_blocks) {
+      capacity += b.m_size;
+    }
+    return capacity;
+  }
+
+private:
+  class block {
+  public:
+    std::unique_ptr<char[]> m_data;
+    std::size_t m_size;
+  };
+
+  std::vector<block> m_blocks;
+  char *m_pos{};
+  char *m_end{};
+  fmt::memory_buffer m_scratch;
+
+  char *allocate(std::size_t size) {
+    if (static_cast<std::size_t>(m_end - m_pos) < size) {
+      std::size_t const block_size = std::max(size, BLOCK_SIZE);
+      m_blocks.push_back(
+          {std::make_unique_for_overwrite<char[]>(block_size), block_size});
+      m_pos = m_blocks.back().m_data.get();
+      m_end = m_pos + block_size;
+    }
+    char *const data = m_pos;
+    m_pos += size;
+    return data;
+  }
+};
+
+#endif // NAME_ARENA_HPP
@@ -0,0 +1,37 @@
+#ifndef NUM_DIGITS_HPP
+#define NUM_DIGITS_HPP
+
+#include <cstddef>
+
+// Helpers to compute the length of formatted indices without formatting them.
+
+// the number of decimal digits of `val`
+inline std::size_t num_digits(std::size_t val) {
+  std::size_t digits = 1;
+  for (; val >= 10; val /= 10) {
+    ++digits;
+  }
+  return digits;
+}
+
+// Returns the total number of decimal digits of `idx / div`, for every `idx`
+// in [first, last). This walks over the powers of 10, not over the indices.
+inline std::size_t
+sum_digits(std::size_t first, std::size_t last, std::size_t div = 1) {
+  std::size_t sum = 0;
+  // the values of `idx / div` below `high` have at most `digits` digits
+  std::size_t high = 10;
+  for (std::size_t digits = 1; first < last; ++digits) {
+    // `high * div` may overflow, but only once it's past `last`
+    std::size_t const band_last =
+        high <= (last - 1) / div ? high * div : last;
+    if (first < band_last) {
+      sum += (band_last - first) * digits;
+      first = band_last;
+    }
+    high *= 10;
+  }
+  return sum;
+}
+
+#endif // NUM_DIGITS_HPP
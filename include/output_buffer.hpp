@@ -0,0 +1,108 @@
+#ifndef OUTPUT_BUFFER_HPP
+#define OUTPUT_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <fmt/format.h>
+#include <ios>
+#include <iterator>
+#include <string_view>
+
+// Collects formatted output in a large in-memory buffer and hands it to the
+// underlying stream in chunks of about `flush_size` bytes, instead of issuing
+// one small stream write per line.
+//
+// `OSTREAM` only needs a `write(char const *, std::streamsize)` member, so
+// this works the same on top of an `output_sink`, which may compress, and on
+// top of a region of memory.
+template <typename OSTREAM>
+class output_buffer {
+public:
+  static constexpr std::size_t DEFAULT_FLUSH_SIZE{std::size_t{1} << 20};
+
+  explicit output_buffer(
+      OSTREAM &os,
+      std::size_t flush_size = DEFAULT_FLUSH_SIZE)
+      : m_os(os),
+        m_flush_size(flush_size) {
+    // leave some headroom so that the last line before a flush doesn't make
+    // the buffer reallocate
+    m_buf.reserve(m_flush_size + m_flush_size / 4);
+  }
+
+  output_buffer(output_buffer const &) = delete;
+  output_buffer &operator=(output_buffer const &) = delete;
+
+  ~output_buffer() {
+    flush();
+  }
+
+  template <typename... T>
+  void print(fmt::format_string<T...> fmt, T &&...args) {
+    fmt::format_to(std::back_inserter(m_buf), fmt, std::forward<T>(args)...);
+    maybe_flush();
+  }
+
+  template <typename... T>
+  void println(fmt::format_string<T...> fmt, T &&...args) {
+    fmt::format_to(std::back_inserter(m_buf), fmt, std::forward<T>(args)...);
+    m_buf.push_back('\n');
+    maybe_flush();
+  }
+
+  void append(std::string_view str) {
+    m_buf.append(str.data(), str.data() + str.size());
+    maybe_flush();
+  }
+
+  void append(char ch) {
+    m_buf.push_back(ch);
+    maybe_flush();
+  }
+
+  // appends the decimal representation of `val`, without going through the
+  // format string machinery
+  void append(std::size_t val) {
+    fmt::format_int const str(val);
+    m_buf.append(str.data(), str.data() + str.size());
+    maybe_flush();
+  }
+
+  // same interface as `std::ostream::write`, so that an `output_buffer` can be
+  // used as the stream of other writers (e.g. `wrapped_writer`)
+  void write(char const *data, std::streamsize size) {
+    m_buf.append(data, data + size);
+    maybe_flush();
+  }
+
+  void flush() {
+    if (m_buf.size() == 0) {
+      return;
+    }
+    m_os.write(m_buf.data(), static_cast<std::streamsize>(m_buf.size()));
+    if (m_bytes_written != nullptr) {
+      m_bytes_written->fetch_add(m_buf.size(), std::memory_order_relaxed);
+    }
+    m_buf.clear();
+  }
+
+  // adds the number of bytes handed to the stream to `bytes_written` at each
+  // flush, e.g. to report the progress of a long write
+  void count_bytes(std::atomic<std::uint64_t> &bytes_written) {
+    m_bytes_written = &bytes_written;
+  }
+
+private:
+  OSTREAM &m_os;
+  std::size_t m_flush_size;
+  fmt::memory_buffer m_buf;
+  std::atomic<std::uint64_t> *m_bytes_written{};
+
+  void maybe_flush() {
+    if (m_buf.size() >= m_flush_size) {
+      flush();
+    }
+  }
+};
+
+#endif // OUTPUT_BUFFER_HPP
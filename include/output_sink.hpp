@@ -0,0 +1,76 @@
+#ifndef OUTPUT_SINK_HPP
+#define OUTPUT_SINK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ios>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "design_config.hpp"
+
+// An output file of the writers, which compresses what it is given with the
+// codec of the config on the way to the disk. It is the `OSTREAM` of their
+// `output_buffer`s, which hand it large chunks, so the virtual calls don't
+// matter.
+class output_sink {
+public:
+  output_sink() = default;
+  output_sink(output_sink const &) = delete;
+  output_sink &operator=(output_sink const &) = delete;
+  virtual ~output_sink() = default;
+
+  // same interface as `std::ostream::write`
+  virtual void write(char const *data, std::streamsize size) = 0;
+
+  // writes out what the compressor still holds and closes the file. It must
+  // be called after the last `write`, since the destructor can't report
+  // errors.
+  virtual void close() = 0;
+
+  // writes out everything it was given, e.g. for a checkpoint, and waits
+  // until it is on the disk, and returns the size of the file. Compressed
+  // files have no such points, and can't be synced.
+  virtual std::uint64_t sync() = 0;
+};
+
+// the lowest and the highest `compress_level` of `codec`, besides 0 for its
+// default level
+std::pair<int, int> compress_level_range(output_codec codec);
+
+// the name of the file written for `name`, e.g. "block.spef.zst"
+std::string
+output_file_name(std::string const &name, design_config const &config);
+
+// the path of an output file: `path`, when it is given (e.g.
+// `config.block_spef_path`), and otherwise the file of `name` in the current
+// directory
+std::string output_path(
+    std::string const &path,
+    std::string const &name,
+    design_config const &config);
+
+// whether the output file at `path` can be written at any offset, e.g. by
+// several threads, unlike stdout ("-") or an existing named pipe
+bool seekable_output(std::string const &path);
+
+// removes the regular file at `path` if it has other hard links, e.g. in the
+// artifact cache, so that it is written as a new file rather than truncated
+// under them
+void unlink_shared_file(std::string const &path);
+
+// creates (or truncates) the file at `path`, or writes to stdout for "-", and
+// throws `std::system_error` if it can't. The file is written strictly in
+// order, so it may be a pipe. With `resume_offset`, the uncompressed file at
+// `path` is truncated to its first `resume_offset` bytes instead, e.g. those of
+// a checkpoint, and written from there. With `compressed_bytes`, the bytes
+// that a compressed file writes to the disk are added to it.
+std::unique_ptr<output_sink> open_output_sink(
+    std::string const &path,
+    design_config const &config,
+    std::uint64_t resume_offset = 0,
+    std::atomic<std::uint64_t> *compressed_bytes = nullptr);
+
+#endif // OUTPUT_SINK_HPP
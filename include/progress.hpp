@@ -0,0 +1,126 @@
+#ifndef PROGRESS_HPP
+#define PROGRESS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// The progress of the generation of one output file. The writers update the
+// counters, through `progress_batch`es where they are hot, and
+// `progress_reporter` reads them from its own thread.
+class file_progress {
+public:
+  std::string m_name;
+  // the number of nets of the file, or 0 if the file doesn't count its nets
+  std::uint64_t m_total_nets{};
+  // the size of the file, or 0 if it isn't known upfront
+  std::uint64_t m_total_bytes{};
+  // whether the file is compressed, when the bytes are those of its content,
+  // and `m_compressed_bytes` those of the file
+  bool m_compressed{};
+
+  // each counter has a cache line of its own, since the nets are generated
+  // and written by different threads
+  alignas(64) std::atomic<std::uint64_t> m_nets_generated;
+  alignas(64) std::atomic<std::uint64_t> m_nets_written;
+  alignas(64) std::atomic<std::uint64_t> m_bytes_written;
+  alignas(64) std::atomic<std::uint64_t> m_compressed_bytes;
+  std::atomic<bool> m_done;
+
+  file_progress(
+      std::string name,
+      std::uint64_t total_nets,
+      std::uint64_t total_bytes,
+      bool compressed)
+      : m_name(std::move(name)),
+        m_total_nets(total_nets),
+        m_total_bytes(total_bytes),
+        m_compressed(compressed) {}
+};
+
+// Counts in a thread local variable, and only adds to the shared counter every
+// `BATCH_SIZE` counts and when destroyed, so that counting stays cheap in hot
+// loops and in many threads.
+class progress_batch {
+public:
+  static constexpr std::uint64_t BATCH_SIZE{1024};
+
+  explicit progress_batch(std::atomic<std::uint64_t> &counter)
+      : m_counter(counter) {}
+
+  progress_batch(progress_batch const &) = delete;
+  progress_batch &operator=(progress_batch const &) = delete;
+
+  ~progress_batch() {
+    flush();
+  }
+
+  void add(std::uint64_t count = 1) {
+    m_count += count;
+    if (m_count >= BATCH_SIZE) {
+      flush();
+    }
+  }
+
+  void flush() {
+    m_counter.fetch_add(m_count, std::memory_order_relaxed);
+    m_count = 0;
+  }
+
+private:
+  std::atomic<std::uint64_t> &m_counter;
+  std::uint64_t m_count{};
+};
+
+// Prints the progress of the files to stderr every `interval`, as one status
+// line, and, if `status_path` isn't empty, rewrites it as a JSON status file
+// every `status_interval` and once more when the reporter is destroyed. A zero
+// `interval` disables the status lines, but not the status file.
+class progress_reporter {
+public:
+  progress_reporter(
+      std::vector<file_progress const *> files,
+      std::chrono::milliseconds interval,
+      std::string status_path,
+      std::chrono::milliseconds status_interval);
+
+  progress_reporter(progress_reporter const &) = delete;
+  progress_reporter &operator=(progress_reporter const &) = delete;
+
+  ~progress_reporter();
+
+private:
+  // what the last report saw of a file, to compute the rates
+  class file_snapshot {
+  public:
+    std::uint64_t m_nets_written{};
+    std::uint64_t m_bytes_written{};
+    double m_nets_per_sec{};
+    double m_mb_per_sec{};
+  };
+
+  std::vector<file_progress const *> m_files;
+  std::vector<file_snapshot> m_snapshots;
+  std::chrono::milliseconds m_interval;
+  std::string m_status_path;
+  std::chrono::milliseconds m_status_interval;
+  std::chrono::steady_clock::time_point m_start;
+  std::chrono::steady_clock::time_point m_last_report;
+  bool m_printed{};
+  std::mutex m_mutex;
+  std::condition_variable_any m_cv;
+  std::jthread m_thread;
+
+  void run(std::stop_token const &stop);
+  void report(bool print, bool write_status);
+  void print_status(double elapsed_sec) const;
+  void write_status_file(double elapsed_sec) const;
+};
+
+#endif // PROGRESS_HPP
@@ -0,0 +1,81 @@
+#ifndef RUN_STATS_HPP
+#define RUN_STATS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "design_config.hpp"
+#include "progress.hpp"
+
+// the CPU time used so far by the calling thread, and by the whole process
+double thread_cpu_sec();
+double process_cpu_sec();
+// the current and the peak resident set size of the process
+std::uint64_t current_rss_bytes();
+std::uint64_t peak_rss_bytes();
+
+// Collects where the time and memory of a run go, phase by phase, and writes
+// it as JSON for `--stats`. The phases of different files may run at the same
+// time, in different threads.
+class run_stats {
+public:
+  class phase {
+  public:
+    // the output file the phase is part of
+    std::string m_file;
+    std::string m_name;
+    double m_wall_sec;
+    // the CPU time of the thread that ran the phase, without the worker
+    // threads it started, which have phases "<name>/worker<k>" of their own
+    double m_thread_cpu_sec;
+    // the CPU time of the whole process during the phase, which includes the
+    // worker threads, but also the phases that ran at the same time
+    double m_process_cpu_sec;
+    std::uint64_t m_rss_after_bytes;
+  };
+
+  run_stats();
+
+  void add(phase p);
+
+  // writes the phases, the size of each file, the totals of the process, and
+  // the config the files were generated with
+  void write(
+      std::string const &path,
+      design_config const &config,
+      std::vector<file_progress const *> const &files) const;
+
+private:
+  std::chrono::steady_clock::time_point m_start;
+  mutable std::mutex m_mutex;
+  std::vector<phase> m_phases;
+};
+
+// Times the phase `name` of `file` from its construction to its destruction,
+// or to `stop`, and adds it to `stats`.
+class phase_timer {
+public:
+  phase_timer(run_stats &stats, std::string file, std::string name);
+
+  phase_timer(phase_timer const &) = delete;
+  phase_timer &operator=(phase_timer const &) = delete;
+
+  ~phase_timer();
+
+  // ends the phase before the end of the scope
+  void stop();
+
+private:
+  run_stats &m_stats;
+  std::string m_file;
+  std::string m_name;
+  std::chrono::steady_clock::time_point m_wall_start;
+  double m_thread_cpu_start;
+  double m_process_cpu_start;
+  bool m_stopped{};
+};
+
+#endif // RUN_STATS_HPP
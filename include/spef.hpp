@@ -1,16 +1,27 @@
 #ifndef SPEF_HPP
 #define SPEF_HPP
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <fmt/format.h>
 #include <libassert/assert.hpp>
+#include <limits>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <optional>
 #include <ranges>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include "name_arena.hpp"
+#include "output_buffer.hpp"
+#include "tenths_table.hpp"
+
 class hier_div {
 public:
   enum { DOT, SLASH, COLON, BAR } div;
@@ -30,8 +41,8 @@ public:
   }
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, "*DIVIDER {}", to_char());
+  void write(output_buffer<OSTREAM> &out) const {
+    out.println("*DIVIDER {}", to_char());
   }
 };
 
@@ -54,8 +65,8 @@ public:
   }
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, "*DELIMITER {}", to_char());
+  void write(output_buffer<OSTREAM> &out) const {
+    out.println("*DELIMITER {}", to_char());
   }
 };
 
@@ -88,8 +99,8 @@ public:
     UNREACHABLE();
   }
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, "*BUS_DELIMITER {}", to_sv());
+  void write(output_buffer<OSTREAM> &out) const {
+    out.println("*BUS_DELIMITER {}", to_sv());
   }
 };
 
@@ -109,8 +120,8 @@ public:
   }
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, "*T_UNIT {} {}", m_val, time_unit_sv());
+  void write(output_buffer<OSTREAM> &out) const {
+    out.println("*T_UNIT {} {}", m_val, time_unit_sv());
   }
 };
 
@@ -130,8 +141,8 @@ public:
   }
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, "*C_UNIT {} {}", m_val, cap_unit_sv());
+  void write(output_buffer<OSTREAM> &out) const {
+    out.println("*C_UNIT {} {}", m_val, cap_unit_sv());
   }
 };
 
@@ -151,8 +162,8 @@ public:
   }
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, "*R_UNIT {} {}", m_val, res_unit_sv());
+  void write(output_buffer<OSTREAM> &out) const {
+    out.println("*R_UNIT {} {}", m_val, res_unit_sv());
   }
 };
 
@@ -174,8 +185,8 @@ public:
   }
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, "*L_UNIT {} {}", m_val, induc_unit_sv());
+  void write(output_buffer<OSTREAM> &out) const {
+    out.println("*L_UNIT {} {}", m_val, induc_unit_sv());
   }
 };
 
@@ -187,11 +198,11 @@ public:
   induc_scale m_induc_scale;
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    m_time_scale.write(os);
-    m_cap_scale.write(os);
-    m_res_scale.write(os);
-    m_induc_scale.write(os);
+  void write(output_buffer<OSTREAM> &out) const {
+    m_time_scale.write(out);
+    m_cap_scale.write(out);
+    m_res_scale.write(out);
+    m_induc_scale.write(out);
   }
 };
 
@@ -200,15 +211,15 @@ public:
   std::vector<std::string> m_flow;
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
+  void write(output_buffer<OSTREAM> &out) const {
     if (m_flow.empty()) {
-      fmt::println(os, R"(*DESIGN_FLOW "")");
+      out.println(R"(*DESIGN_FLOW "")");
     } else {
-      fmt::print(os, "*DESIGN_FLOW");
+      out.print("*DESIGN_FLOW");
       for (std::string const &flow : m_flow) {
-        fmt::print(os, R"( "{}")", flow);
+        out.print(R"( "{}")", flow);
       }
-      fmt::println(os, "");
+      out.append('\n');
     }
   }
 };
@@ -229,36 +240,56 @@ public:
   std::vector<std::string> m_comments;
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, R"(*SPEF "{}")", m_SPEF_version);
-    fmt::println(os, R"(*DESIGN "{}")", m_design_name);
-    fmt::println(os, R"(*DATE "{}")", m_date);
-    fmt::println(os, R"(*VENDOR "{}")", m_vendor);
-    fmt::println(os, R"(*PROGRAM "{}")", m_program_name);
-    fmt::println(os, R"(*VERSION "{}")", m_program_version);
-    m_design_flow.write(os);
-    m_hier_div.write(os);
-    m_pin_delim.write(os);
-    m_bus_delim.write(os);
-    m_unit_def.write(os);
+  void write(output_buffer<OSTREAM> &out) const {
+    out.println(R"(*SPEF "{}")", m_SPEF_version);
+    out.println(R"(*DESIGN "{}")", m_design_name);
+    out.println(R"(*DATE "{}")", m_date);
+    out.println(R"(*VENDOR "{}")", m_vendor);
+    out.println(R"(*PROGRAM "{}")", m_program_name);
+    out.println(R"(*VERSION "{}")", m_program_version);
+    m_design_flow.write(out);
+    m_hier_div.write(out);
+    m_pin_delim.write(out);
+    m_bus_delim.write(out);
+    m_unit_def.write(out);
     for (auto const &comment : m_comments) {
-      fmt::println(os, "// {}", comment);
+      out.println("// {}", comment);
     }
   }
 };
 
 class name_map {
 public:
+  // maps `*<m_first_index + k>` to `<m_prefix><m_first_suffix + k>`, for each
+  // k in [0, m_size), without storing every name
+  class name_range {
+  public:
+    std::uint64_t m_first_index;
+    std::uint64_t m_size;
+    std::string m_prefix;
+    std::uint64_t m_first_suffix;
+  };
+
   std::map<std::uint64_t, std::string> m_map;
+  std::vector<name_range> m_ranges;
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    if (m_map.empty()) {
+  void write(output_buffer<OSTREAM> &out) const {
+    if (m_map.empty() && m_ranges.empty()) {
       return;
     }
-    fmt::println(os, "*NAME_MAP");
+    out.println("*NAME_MAP");
+    for (name_range const &range : m_ranges) {
+      for (std::uint64_t idx = 0; idx < range.m_size; ++idx) {
+        out.println(
+            "*{} {}{}",
+            range.m_first_index + idx,
+            range.m_prefix,
+            range.m_first_suffix + idx);
+      }
+    }
     for (auto const &[index, name] : m_map) {
-      fmt::println(os, "*{} {}", index, name);
+      out.println("*{} {}", index, name);
     }
   }
 };
@@ -269,20 +300,20 @@ public:
   std::vector<std::string> m_ground_nets;
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
+  void write(output_buffer<OSTREAM> &out) const {
     if (!m_power_nets.empty()) {
-      fmt::print(os, "*POWER_NETS");
+      out.print("*POWER_NETS");
       for (std::string const &power_net : m_power_nets) {
-        fmt::print(os, " {}", power_net);
+        out.print(" {}", power_net);
       }
-      fmt::println(os, "");
+      out.append('\n');
     }
     if (!m_ground_nets.empty()) {
-      fmt::print(os, "*GROUND_NETS");
+      out.print("*GROUND_NETS");
       for (std::string const &ground_net : m_ground_nets) {
-        fmt::print(os, " {}", ground_net);
+        out.print(" {}", ground_net);
       }
-      fmt::println(os, "");
+      out.append('\n');
     }
   }
 };
@@ -309,38 +340,86 @@ public:
   std::uint64_t x;
   std::uint64_t y;
 
-  [[nodiscard]] std::string to_string() const {
-    return fmt::format("*C {} {}", x, y);
+  template <typename OSTREAM>
+  void write(output_buffer<OSTREAM> &out) const {
+    out.print("*C {} {}", x, y);
   }
 };
 
+// Writes `val` as "{:.1f}". The multiples of 0.1, e.g. the quantized
+// capacitances, are looked up in `tenths_table` instead of being formatted.
+template <typename OSTREAM>
+void write_value(output_buffer<OSTREAM> &out, double val) {
+  if (auto const str = tenths_table::find(val)) {
+    out.append(*str);
+  } else {
+    out.print("{:.1f}", val);
+  }
+}
+
+// A single value, or a triplet of values for the best, typical and worst
+// corners, stored inline.
 template <typename T>
 class multivalue {
 public:
-  // TODO: we should use a data structure that has constant size
-  std::vector<T> m_value;
-  explicit multivalue(std::size_t size, T val = {}) : m_value(size, val) {}
-  multivalue(std::initializer_list<T> value) : m_value(value) {}
+  static constexpr std::size_t MAX_SIZE{3};
+
+  explicit multivalue(std::size_t size, T val = {})
+      : m_size(static_cast<std::uint8_t>(size)) {
+    ASSERT(size == 1 || size == MAX_SIZE, "a value or a triplet", size);
+    std::ranges::fill(*this, val);
+  }
+  multivalue(std::initializer_list<T> value)
+      : m_size(static_cast<std::uint8_t>(value.size())) {
+    ASSERT(
+        value.size() == 1 || value.size() == MAX_SIZE,
+        "a value or a triplet",
+        value.size());
+    std::ranges::copy(value, m_value.begin());
+  }
+
+  [[nodiscard]] std::size_t size() const {
+    return m_size;
+  }
+
+  [[nodiscard]] T *begin() {
+    return m_value.data();
+  }
+  [[nodiscard]] T *end() {
+    return m_value.data() + m_size;
+  }
+  [[nodiscard]] T const *begin() const {
+    return m_value.data();
+  }
+  [[nodiscard]] T const *end() const {
+    return m_value.data() + m_size;
+  }
 
-  [[nodiscard]] std::string to_string() const {
-    ASSERT(!m_value.empty());
+  [[nodiscard]] T const &operator[](std::size_t idx) const {
+    return m_value[idx];
+  }
 
-    std::string ret_str = fmt::format("{:.1f}", m_value[0]);
-    for (auto const &val : m_value | std::views::drop(1)) {
-      ret_str += fmt::format(":{:.1f}", val);
+  template <typename OSTREAM>
+  void write(output_buffer<OSTREAM> &out) const {
+    write_value(out, m_value[0]);
+    for (auto const &val : *this | std::views::drop(1)) {
+      out.append(':');
+      write_value(out, val);
     }
-    return ret_str;
   }
 
   [[nodiscard]] multivalue<T> operator+(multivalue<T> const &other) const {
-    ASSERT(m_value.size() == other.m_value.size());
-    multivalue<T> ret_value(m_value.size());
-    ret_value.m_value.resize(m_value.size());
-    for (std::size_t idx = 0; idx < ret_value.m_value.size(); ++idx) {
+    ASSERT(m_size == other.m_size);
+    multivalue<T> ret_value(m_size);
+    for (std::size_t idx = 0; idx < m_size; ++idx) {
       ret_value.m_value[idx] = m_value[idx] + other.m_value[idx];
     }
     return ret_value;
   }
+
+private:
+  std::array<T, MAX_SIZE> m_value{};
+  std::uint8_t m_size;
 };
 
 using par_value = multivalue<double>;
@@ -349,8 +428,10 @@ class cap_load {
 public:
   par_value m_par_value;
 
-  [[nodiscard]] std::string to_string() const {
-    return fmt::format("*L {}", m_par_value.to_string());
+  template <typename OSTREAM>
+  void write(output_buffer<OSTREAM> &out) const {
+    out.append("*L ");
+    m_par_value.write(out);
   }
 };
 
@@ -360,8 +441,9 @@ class threshold {
 public:
   pos_fraction m_value;
 
-  [[nodiscard]] std::string to_string() const {
-    return m_value.to_string();
+  template <typename OSTREAM>
+  void write(output_buffer<OSTREAM> &out) const {
+    m_value.write(out);
   }
 };
 
@@ -370,19 +452,18 @@ public:
   std::pair<par_value, par_value> m_slews;
   std::optional<std::pair<threshold, threshold>> m_thresholds;
 
-  [[nodiscard]] std::string to_string() const {
-    std::string ret_str;
-    ret_str += fmt::format(
-        "*S {} {}",
-        m_slews.first.to_string(),
-        m_slews.second.to_string());
+  template <typename OSTREAM>
+  void write(output_buffer<OSTREAM> &out) const {
+    out.append("*S ");
+    m_slews.first.write(out);
+    out.append(' ');
+    m_slews.second.write(out);
     if (m_thresholds) {
-      ret_str += fmt::format(
-          " {} {}",
-          m_thresholds->first.to_string(),
-          m_thresholds->second.to_string());
+      out.append(' ');
+      m_thresholds->first.write(out);
+      out.append(' ');
+      m_thresholds->second.write(out);
     }
-    return ret_str;
   }
 };
 
@@ -390,8 +471,9 @@ class driving_cell {
 public:
   std::string m_cell_type;
 
-  [[nodiscard]] std::string to_string() const {
-    return fmt::format("*D {}", m_cell_type);
+  template <typename OSTREAM>
+  void write(output_buffer<OSTREAM> &out) const {
+    out.print("*D {}", m_cell_type);
   }
 };
 
@@ -399,10 +481,9 @@ class conn_attr {
 public:
   std::variant<coordinates, cap_load, slews, driving_cell> m_attr;
 
-  [[nodiscard]] std::string to_string() const {
-    return std::visit(
-        [](auto &&arg) -> std::string { return arg.to_string(); },
-        m_attr);
+  template <typename OSTREAM>
+  void write(output_buffer<OSTREAM> &out) const {
+    std::visit([&out](auto const &attr) { attr.write(out); }, m_attr);
   }
 };
 
@@ -413,17 +494,13 @@ public:
   std::optional<conn_attr> m_conn_attr;
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
+  void write(output_buffer<OSTREAM> &out) const {
+    out.print("{} {}", m_port_name, m_direction.to_char());
     if (m_conn_attr) {
-      fmt::println(
-          os,
-          "{} {} {}",
-          m_port_name,
-          m_direction.to_char(),
-          m_conn_attr->to_string());
-    } else {
-      fmt::println(os, "{} {}", m_port_name, m_direction.to_char());
+      out.append(' ');
+      m_conn_attr->write(out);
     }
+    out.append('\n');
   }
 };
 
@@ -432,14 +509,14 @@ public:
   std::vector<port_entry> m_port_entries;
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
+  void write(output_buffer<OSTREAM> &out) const {
     if (m_port_entries.empty()) {
       return;
     }
 
-    fmt::println(os, "*PORTS");
+    out.println("*PORTS");
     for (port_entry const &entry : m_port_entries) {
-      entry.write(os);
+      entry.write(out);
     }
   }
 };
@@ -450,173 +527,407 @@ public:
   // physical_port_def m_port_def;
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    m_port_def.write(os);
+  void write(output_buffer<OSTREAM> &out) const {
+    m_port_def.write(out);
   }
 };
 
 class conn_def {
 public:
   bool m_is_external;
-  std::string m_name;
+  std::string_view m_name;
   direction m_direction;
   std::optional<conn_attr> m_conn_attr;
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::print(
-        os,
+  void write(output_buffer<OSTREAM> &out) const {
+    out.print(
         "*{} {} {}",
         m_is_external ? 'P' : 'I',
         m_name,
         m_direction.to_char());
     if (m_conn_attr) {
-      fmt::print(os, " {}", m_conn_attr->to_string());
+      out.append(' ');
+      m_conn_attr->write(out);
     }
-    fmt::println(os, "");
+    out.append('\n');
   }
 };
 
 class internal_node_coord {
 public:
-  std::pair<std::string, coordinates> m_internal_node;
+  std::pair<std::string_view, coordinates> m_internal_node;
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(
-        os,
-        "*N {} {}",
-        m_internal_node.first,
-        m_internal_node.second.to_string());
+  void write(output_buffer<OSTREAM> &out) const {
+    out.print("*N {} ", m_internal_node.first);
+    m_internal_node.second.write(out);
+    out.append('\n');
   }
 };
 
 class conn_sec {
 public:
-  std::vector<conn_def> m_conn_def;
-  std::vector<internal_node_coord> m_internal_node_coord;
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
+  std::pmr::vector<conn_def> m_conn_def;
+  std::pmr::vector<internal_node_coord> m_internal_node_coord;
+
+  conn_sec() = default;
+  explicit conn_sec(allocator_type alloc)
+      : m_conn_def(alloc),
+        m_internal_node_coord(alloc) {}
+
+  // the nodes of a net are its pins, followed by its internal nodes
+  [[nodiscard]] std::size_t num_nodes() const {
+    return m_conn_def.size() + m_internal_node_coord.size();
+  }
+
+  [[nodiscard]] std::string_view node_name(std::size_t node_idx) const {
+    if (node_idx < m_conn_def.size()) {
+      return m_conn_def[node_idx].m_name;
+    }
+    return m_internal_node_coord[node_idx - m_conn_def.size()]
+        .m_internal_node.first;
+  }
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, "*CONN");
+  void write(output_buffer<OSTREAM> &out) const {
+    out.println("*CONN");
     for (conn_def const &def : m_conn_def) {
-      def.write(os);
+      def.write(out);
     }
     for (internal_node_coord const &internal_node : m_internal_node_coord) {
-      internal_node.write(os);
+      internal_node.write(out);
     }
   }
 };
 
 class cap {
 public:
-  std::string m_node1;
-  std::optional<std::string> m_node2;
+  std::string_view m_node1;
+  std::optional<std::string_view> m_node2;
   par_value m_par_value;
 
-  cap(std::string node1, std::initializer_list<double> value)
-      : m_node1(std::move(node1)),
+  cap(std::string_view node1, std::initializer_list<double> value)
+      : m_node1(node1),
         m_par_value(value) {}
-  cap(std::string node1, std::string node2, std::initializer_list<double> value)
-      : m_node1(std::move(node1)),
-        m_node2(std::move(node2)),
+  cap(std::string_view node1,
+      std::string_view node2,
+      std::initializer_list<double> value)
+      : m_node1(node1),
+        m_node2(node2),
         m_par_value(value) {}
 
-  [[nodiscard]] std::string to_string() const {
+  template <typename OSTREAM>
+  void write(output_buffer<OSTREAM> &out) const {
+    out.append(m_node1);
+    out.append(' ');
     if (m_node2) {
-      return fmt::format(
-          "{} {} {}",
-          m_node1,
-          *m_node2,
-          m_par_value.to_string());
+      out.append(*m_node2);
+      out.append(' ');
+    }
+    m_par_value.write(out);
+  }
+};
+
+// The coupling capacitances of a file. Each one is stored once, as the
+// indices of its two nets, of a node in each of them (see
+// `conn_sec::node_name`) and its value, and is written in the `*CAP` section of
+// both nets. The node names are only formatted when the nets are written.
+class coupling_caps {
+public:
+  class coupling_cap {
+  public:
+    std::uint32_t m_net1;
+    std::uint32_t m_net2;
+    std::uint8_t m_node1;
+    std::uint8_t m_node2;
+    double m_value;
+  };
+  static_assert(sizeof(coupling_cap) == 24);
+
+  // in the order they were added
+  std::vector<coupling_cap> m_caps;
+  // the capacitances of net `net_idx` are
+  // `m_caps[m_net_caps[m_offsets[net_idx]]]` up to
+  // `m_caps[m_net_caps[m_offsets[net_idx + 1]]]`, in the order they were
+  // added, once `index` is called
+  std::vector<std::size_t> m_offsets;
+  std::vector<std::uint32_t> m_net_caps;
+
+  [[nodiscard]] static coupling_cap make(
+      std::size_t net1,
+      std::size_t node1,
+      std::size_t net2,
+      std::size_t node2,
+      double value) {
+    ASSERT(net1 <= std::numeric_limits<std::uint32_t>::max());
+    ASSERT(net2 <= std::numeric_limits<std::uint32_t>::max());
+    ASSERT(node1 <= std::numeric_limits<std::uint8_t>::max());
+    ASSERT(node2 <= std::numeric_limits<std::uint8_t>::max());
+    return {
+        static_cast<std::uint32_t>(net1),
+        static_cast<std::uint32_t>(net2),
+        static_cast<std::uint8_t>(node1),
+        static_cast<std::uint8_t>(node2),
+        value};
+  }
+
+  void add(
+      std::size_t net1,
+      std::size_t node1,
+      std::size_t net2,
+      std::size_t node2,
+      double value) {
+    m_caps.push_back(make(net1, node1, net2, node2, value));
+  }
+
+  // groups the capacitances by net, after the last `add`
+  void index(std::size_t num_nets) {
+    ASSERT(m_caps.size() <= std::numeric_limits<std::uint32_t>::max());
+    m_offsets.assign(num_nets + 1, 0);
+    for (coupling_cap const &c : m_caps) {
+      ++m_offsets[c.m_net1 + 1];
+      ++m_offsets[c.m_net2 + 1];
+    }
+    for (std::size_t net_idx = 0; net_idx < num_nets; ++net_idx) {
+      m_offsets[net_idx + 1] += m_offsets[net_idx];
+    }
+    m_net_caps.resize(m_offsets.back());
+    std::vector<std::size_t> next(m_offsets.begin(), m_offsets.end() - 1);
+    for (std::size_t cap_idx = 0; cap_idx < m_caps.size(); ++cap_idx) {
+      coupling_cap const &c = m_caps[cap_idx];
+      m_net_caps[next[c.m_net1]++] = static_cast<std::uint32_t>(cap_idx);
+      m_net_caps[next[c.m_net2]++] = static_cast<std::uint32_t>(cap_idx);
+    }
+  }
+
+  // calls `func(node_idx, other_net_idx, other_node_idx, value)` for each
+  // coupling capacitance of net `net_idx`
+  template <typename FUNC>
+  void for_each(std::size_t net_idx, FUNC &&func) const {
+    if (net_idx + 1 >= m_offsets.size()) {
+      return;
+    }
+    for (std::size_t pos = m_offsets[net_idx]; pos < m_offsets[net_idx + 1];
+         ++pos) {
+      coupling_cap const &c = m_caps[m_net_caps[pos]];
+      if (c.m_net1 == net_idx) {
+        func(c.m_node1, c.m_net2, c.m_node2, c.m_value);
+      } else {
+        func(c.m_node2, c.m_net1, c.m_node1, c.m_value);
+      }
     }
-    return fmt::format("{} {}", m_node1, m_par_value.to_string());
   }
 };
 
 class cap_sec {
 public:
-  std::vector<cap> m_caps;
+  using allocator_type = std::pmr::polymorphic_allocator<>;
 
-  template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, "*CAP");
+  // the capacitances to ground, the coupling capacitances are in
+  // `coupling_caps`
+  std::pmr::vector<cap> m_caps;
+  // the sum of the ground and coupling capacitances of the net, in the order
+  // they were added, which must be the order they are written in
+  par_value m_total{0.0};
+
+  cap_sec() = default;
+  explicit cap_sec(allocator_type alloc) : m_caps(alloc) {}
+
+  void add(cap c) {
+    if (m_caps.empty()) {
+      m_total = par_value(c.m_par_value.size());
+    }
+    m_total = m_total + c.m_par_value;
+    m_caps.push_back(std::move(c));
+  }
+
+  // adds a coupling capacitance to the total, after the ground capacitances
+  void add_coupling(double value) {
+    m_total = m_total + par_value{value};
+  }
+
+  void clear() {
+    m_caps.clear();
+    m_total = par_value{0.0};
+  }
+
+  // `node_name(net_idx, node_idx)` returns the name of a node of any net
+  template <typename OSTREAM, typename NODE_NAME>
+  void write(
+      output_buffer<OSTREAM> &out,
+      std::size_t net_idx,
+      coupling_caps const &ccaps,
+      NODE_NAME const &node_name) const {
+    out.println("*CAP");
     std::size_t idx = 1;
     for (cap const &c : m_caps) {
-      fmt::println(os, "{} {}", idx++, c.to_string());
+      out.append(idx++);
+      out.append(' ');
+      c.write(out);
+      out.append('\n');
     }
+    ccaps.for_each(
+        net_idx,
+        [&](std::size_t node_idx,
+            std::size_t other_net_idx,
+            std::size_t other_node_idx,
+            double value) {
+          out.print(
+              "{} {} {} ",
+              idx++,
+              node_name(net_idx, node_idx),
+              node_name(other_net_idx, other_node_idx));
+          write_value(out, value);
+          out.append('\n');
+        });
   }
 };
 
 class res {
 public:
-  std::string m_node1;
-  std::string m_node2;
+  std::string_view m_node1;
+  std::string_view m_node2;
   par_value m_par_value;
 
-  res(std::string node1, std::string node2, std::initializer_list<double> value)
-      : m_node1(std::move(node1)),
-        m_node2(std::move(node2)),
+  res(std::string_view node1,
+      std::string_view node2,
+      std::initializer_list<double> value)
+      : m_node1(node1),
+        m_node2(node2),
         m_par_value(value) {}
 
-  [[nodiscard]] std::string to_string() const {
-    return fmt::format("{} {} {}", m_node1, m_node2, m_par_value.to_string());
+  template <typename OSTREAM>
+  void write(output_buffer<OSTREAM> &out) const {
+    out.print("{} {} ", m_node1, m_node2);
+    m_par_value.write(out);
   }
 };
 
 class res_sec {
 public:
-  std::vector<res> m_ress;
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
+  std::pmr::vector<res> m_ress;
+
+  res_sec() = default;
+  explicit res_sec(allocator_type alloc) : m_ress(alloc) {}
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, "*RES");
+  void write(output_buffer<OSTREAM> &out) const {
+    out.println("*RES");
     std::size_t idx = 1;
     for (res const &r : m_ress) {
-      fmt::println(os, "{} {}", idx++, r.to_string());
+      out.append(idx++);
+      out.append(' ');
+      r.write(out);
+      out.append('\n');
     }
   }
 };
 
 class d_net {
 public:
-  std::string m_net_ref;
+  // the allocator of the sections, e.g. one from a `monotonic_buffer_resource`
+  // shared by many nets, which then don't need to free their memory one by one
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
+  std::string_view m_net_ref;
   // routing_conf m_routing_conf;
   conn_sec m_conn_sec;
   cap_sec m_cap_sec;
   res_sec m_res_sec;
   // induc_sec m_induc_sec;
 
-  [[nodiscard]] par_value total_cap() const {
-    std::size_t num_corners = m_cap_sec.m_caps[0].m_par_value.m_value.size();
-    par_value total(num_corners);
-
-    for (cap const &c : m_cap_sec.m_caps) {
-      total = total + c.m_par_value;
-    }
-    return total;
-  }
-
-  template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    fmt::println(os, "*D_NET {} {}", m_net_ref, total_cap().to_string());
-    m_conn_sec.write(os);
-    m_cap_sec.write(os);
-    m_res_sec.write(os);
-    fmt::println(os, "*END");
+  d_net() = default;
+  explicit d_net(allocator_type alloc)
+      : m_conn_sec(alloc),
+        m_cap_sec(alloc),
+        m_res_sec(alloc) {}
+
+  [[nodiscard]] par_value const &total_cap() const {
+    return m_cap_sec.m_total;
+  }
+
+  // adds the coupling capacitances of net `net_idx` in `ccaps` to the total,
+  // once all the ground capacitances are in
+  void add_coupling_caps(std::size_t net_idx, coupling_caps const &ccaps) {
+    ccaps.for_each(
+        net_idx,
+        [this](std::size_t, std::size_t, std::size_t, double value) {
+          m_cap_sec.add_coupling(value);
+        });
+  }
+
+  void clear() {
+    m_net_ref = {};
+    m_conn_sec.m_conn_def.clear();
+    m_conn_sec.m_internal_node_coord.clear();
+    m_cap_sec.clear();
+    m_res_sec.m_ress.clear();
+  }
+
+  // `net_idx` is the index of this net in `ccaps`, whose capacitances must
+  // have been added with `add_coupling_caps`, and `node_name(net_idx,
+  // node_idx)` returns the name of a node of any net
+  template <typename OSTREAM, typename NODE_NAME>
+  void write(
+      output_buffer<OSTREAM> &out,
+      std::size_t net_idx,
+      coupling_caps const &ccaps,
+      NODE_NAME const &node_name) const {
+    out.print("*D_NET {} ", m_net_ref);
+    total_cap().write(out);
+    out.append('\n');
+    m_conn_sec.write(out);
+    m_cap_sec.write(out, net_idx, ccaps, node_name);
+    m_res_sec.write(out);
+    out.println("*END");
   }
 };
 
 class internal_def {
 public:
+  // the memory of the sections of `m_d_nets`, in slabs that are released all
+  // at once, with one resource per thread that generates nets
+  std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>>
+      m_resources;
+  // the net and node names of `m_d_nets`
+  name_arena m_names;
   std::vector<d_net> m_d_nets;
+  coupling_caps m_coupling_caps;
   // std::vector<r_net> m_r_nets;
   // std::vector<d_pnet> m_d_pnets;
   // std::vector<r_pnet> m_r_pnets;
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    for (d_net const &net : m_d_nets) {
-      net.write(os);
+  void write(output_buffer<OSTREAM> &out) const {
+    write(out, [] {});
+  }
+
+  // calls `on_net_written()` after writing each net
+  template <typename OSTREAM, typename ON_NET_WRITTEN>
+  void
+  write(output_buffer<OSTREAM> &out, ON_NET_WRITTEN on_net_written) const {
+    write(out, 0, m_d_nets.size(), std::move(on_net_written));
+  }
+
+  // writes the nets in [first_idx, last_idx), e.g. those of one of several
+  // files, whose coupling capacitances still name the nodes of the others
+  template <typename OSTREAM, typename ON_NET_WRITTEN>
+  void write(
+      output_buffer<OSTREAM> &out,
+      std::size_t first_idx,
+      std::size_t last_idx,
+      ON_NET_WRITTEN on_net_written) const {
+    auto const node_name = [this](std::size_t net_idx, std::size_t node_idx)
+        -> std::string_view {
+      return m_d_nets[net_idx].m_conn_sec.node_name(node_idx);
+    };
+    for (std::size_t net_idx = first_idx; net_idx < last_idx; ++net_idx) {
+      m_d_nets[net_idx].write(out, net_idx, m_coupling_caps, node_name);
+      on_net_written();
     }
   }
 };
@@ -632,12 +943,25 @@ public:
   internal_def m_internal_def;
 
   template <typename OSTREAM>
-  void write(OSTREAM &os) const {
-    m_header_def.write(os);
-    m_name_map.write(os);
-    m_power_def.write(os);
-    m_external_def.write(os);
-    m_internal_def.write(os);
+  void write(output_buffer<OSTREAM> &out) const {
+    write(out, [] {});
+  }
+
+  // calls `on_net_written()` after writing each net
+  template <typename OSTREAM, typename ON_NET_WRITTEN>
+  void
+  write(output_buffer<OSTREAM> &out, ON_NET_WRITTEN on_net_written) const {
+    write_head(out);
+    m_internal_def.write(out, std::move(on_net_written));
+  }
+
+  // writes everything before the nets
+  template <typename OSTREAM>
+  void write_head(output_buffer<OSTREAM> &out) const {
+    m_header_def.write(out);
+    m_name_map.write(out);
+    m_power_def.write(out);
+    m_external_def.write(out);
   }
 };
 #endif  // SPEF_HPP
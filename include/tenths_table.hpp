@@ -0,0 +1,70 @@
+#ifndef TENTHS_TABLE_HPP
+#define TENTHS_TABLE_HPP
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// The "{:.1f}" strings of the multiples of 0.1 in [0, SIZE / 10), built at
+// compile time, so that such values are written by looking them up instead of
+// formatting a double.
+class tenths_table {
+public:
+  static constexpr std::size_t SIZE{std::size_t{1} << 12};
+
+  // the string of `val` if it is one of the values of the table, up to the
+  // rounding errors of computing it, e.g. as k / 10 or as a sum of those
+  [[nodiscard]] static std::optional<std::string_view> find(double val) {
+    double const scaled = val * 10;
+    double const tenths = std::nearbyint(scaled);
+    // so far from the rounding boundaries of "{:.1f}" (k +- 0.5) / 10 that it
+    // formats as k / 10 too
+    if (std::signbit(val) || tenths >= static_cast<double>(SIZE)
+        || std::abs(scaled - tenths) > 1e-6) {
+      return std::nullopt;
+    }
+    return TABLE[static_cast<std::size_t>(tenths)];
+  }
+
+  [[nodiscard]] constexpr std::string_view
+  operator[](std::size_t tenths) const {
+    return {&m_chars[tenths * ENTRY_SIZE], m_sizes[tenths]};
+  }
+
+private:
+  // "409.5" and shorter
+  static constexpr std::size_t ENTRY_SIZE{5};
+
+  std::array<char, SIZE * ENTRY_SIZE> m_chars{};
+  std::array<std::uint8_t, SIZE> m_sizes{};
+
+  constexpr tenths_table() {
+    for (std::size_t tenths = 0; tenths < SIZE; ++tenths) {
+      // the digits of the integer part, backwards
+      std::array<char, ENTRY_SIZE> digits{};
+      std::size_t num_digits = 0;
+      std::size_t int_part = tenths / 10;
+      do {
+        digits[num_digits++] = static_cast<char>('0' + int_part % 10);
+        int_part /= 10;
+      } while (int_part != 0);
+
+      char *const entry = &m_chars[tenths * ENTRY_SIZE];
+      std::size_t pos = 0;
+      while (num_digits != 0) {
+        entry[pos++] = digits[--num_digits];
+      }
+      entry[pos++] = '.';
+      entry[pos++] = static_cast<char>('0' + tenths % 10);
+      m_sizes[tenths] = static_cast<std::uint8_t>(pos);
+    }
+  }
+
+  static tenths_table const TABLE;
+};
+
+inline constexpr tenths_table tenths_table::TABLE{};
+
+#endif // TENTHS_TABLE_HPP
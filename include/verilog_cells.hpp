@@ -0,0 +1,95 @@
+#ifndef VERILOG_CELLS_HPP
+#define VERILOG_CELLS_HPP
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+
+#include "design_config.hpp"
+#include "output_buffer.hpp"
+#include "wrapped_writer.hpp"
+
+// The constant parts of the cell lines, which only differ in their indices:
+//   "<cell_head><idx><cell_inp><idx / 2><cell_out><idx><tail>"
+//   "<leaf_head><idx><leaf_inp><idx / 2><tail>"
+class cell_line_parts {
+public:
+  std::string m_cell_head;
+  std::string m_cell_inp;
+  std::string m_cell_out;
+  std::string m_leaf_head;
+  std::string m_leaf_inp;
+  static constexpr std::string_view m_tail{"));\n"};
+
+  explicit cell_line_parts(design_config const &config)
+      : m_cell_head(
+            fmt::format("  {} {}", config.lib_cell_name, config.cell_prefix)),
+        m_cell_inp(
+            fmt::format("(.{}({}", config.lib_cell_inp_pin, config.net_prefix)),
+        m_cell_out(fmt::format(
+            "), .{}({}",
+            config.lib_cell_out_pin,
+            config.net_prefix)),
+        m_leaf_head(fmt::format(
+            "  {} {}",
+            config.lib_leaf_cell_name,
+            config.cell_prefix)),
+        m_leaf_inp(fmt::format(
+            "(.{}({}",
+            config.lib_leaf_cell_d_pin,
+            config.net_prefix)) {}
+};
+
+// Writes the `wire` declaration of the nets of the block, wrapped at
+// `num_cols`.
+template <typename OSTREAM>
+void write_wires(output_buffer<OSTREAM> &out, design_config const &config) {
+  wrapped_writer wire_line(out, 2, 2, config.num_cols);
+  wire_line.print("wire {}1", config.net_prefix);
+  for (std::size_t net_idx = 2; net_idx < config.num_nets; ++net_idx) {
+    wire_line.print(", {}{}", config.net_prefix, net_idx);
+  }
+  wire_line.append(";");
+  wire_line.finish();
+}
+
+// Writes the lines of the cells with index in [first_idx, last_idx). Indices
+// in [2, num_nets) are buffers and indices in [num_nets, 2 * num_nets) are
+// leaf cells.
+template <typename OSTREAM>
+void write_cells(
+    output_buffer<OSTREAM> &out,
+    design_config const &config,
+    cell_line_parts const &parts,
+    std::size_t first_idx,
+    std::size_t last_idx) {
+  std::size_t const last_cell_idx = std::min(last_idx, config.num_nets);
+  for (std::size_t net_idx = std::max<std::size_t>(first_idx, 2);
+       net_idx < last_cell_idx;
+       ++net_idx) {
+    // "  IV u<net_idx>(.A(n<net_idx / 2>), .Z(n<net_idx>));"
+    out.append(parts.m_cell_head);
+    out.append(net_idx);
+    out.append(parts.m_cell_inp);
+    out.append(net_idx / 2);
+    out.append(parts.m_cell_out);
+    out.append(net_idx);
+    out.append(parts.m_tail);
+  }
+
+  // leaf cells
+  std::size_t const last_leaf_idx = std::min(last_idx, 2 * config.num_nets);
+  for (std::size_t net_idx = std::max(first_idx, config.num_nets);
+       net_idx < last_leaf_idx;
+       ++net_idx) {
+    // "  FD1 u<net_idx>(.D(n<net_idx / 2>));"
+    out.append(parts.m_leaf_head);
+    out.append(net_idx);
+    out.append(parts.m_leaf_inp);
+    out.append(net_idx / 2);
+    out.append(parts.m_tail);
+  }
+}
+
+#endif // VERILOG_CELLS_HPP
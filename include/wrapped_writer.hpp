@@ -0,0 +1,197 @@
+#ifndef WRAPPED_WRITER_HPP
+#define WRAPPED_WRITER_HPP
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <ios>
+#include <iterator>
+#include <string_view>
+
+// The line breaking rules shared by `wrapped_writer` and `wrapped_size`.
+// Words are placed greedily: a word goes on the current line if it fits in
+// `column` characters (counting the indentation), otherwise it starts a new
+// line. Words that don't fit in a line by themselves get a line of their own.
+// If either indent doesn't leave any room for text, every word gets a line of
+// its own.
+class wrap_layout {
+public:
+  wrap_layout(
+      std::size_t first_indent,
+      std::size_t rest_indent,
+      std::size_t column)
+      : m_first_indent(first_indent),
+        m_rest_indent(rest_indent),
+        m_column(column),
+        m_too_long_indent(first_indent >= column || rest_indent >= column) {}
+
+  // places a word of `len` characters, and returns whether it starts a new
+  // line, i.e. whether the current line is complete
+  bool add_word(std::size_t len) {
+    if (!m_has_word) {
+      m_line_len = len;
+      m_has_word = true;
+      return false;
+    }
+    if (!m_too_long_indent && m_line_len + 1 + len <= m_column - indent()) {
+      m_line_len += 1 + len;
+      return false;
+    }
+    m_first_line = false;
+    m_line_len = len;
+    return true;
+  }
+
+  [[nodiscard]] bool too_long_indent() const {
+    return m_too_long_indent;
+  }
+
+  // whether the current line contains at least one word
+  [[nodiscard]] bool has_word() const {
+    return m_has_word;
+  }
+
+  // the indentation of the current line
+  [[nodiscard]] std::size_t indent() const {
+    return m_first_line ? m_first_indent : m_rest_indent;
+  }
+
+  // the size of the current line, including the indentation and the newline
+  [[nodiscard]] std::size_t line_size() const {
+    return indent() + m_line_len + 1;
+  }
+
+private:
+  std::size_t m_first_indent;
+  std::size_t m_rest_indent;
+  std::size_t m_column;
+  bool m_too_long_indent;
+  bool m_first_line{true};
+  bool m_has_word{};
+  std::size_t m_line_len{};
+};
+
+// Writes a stream of text wrapped at `column`, breaking lines only at spaces
+// (see `wrap_layout`). The first line is indented by `first_indent` spaces and
+// every other line by `rest_indent` spaces.
+//
+// The text is fed in pieces through `print`/`append` and is never materialized
+// as a whole: only the current line and the current word are kept in memory.
+template <typename OSTREAM>
+class wrapped_writer {
+public:
+  wrapped_writer(
+      OSTREAM &os,
+      std::size_t first_indent,
+      std::size_t rest_indent,
+      std::size_t column)
+      : m_os(os),
+        m_layout(first_indent, rest_indent, column) {
+    start_line();
+  }
+
+  wrapped_writer(wrapped_writer const &) = delete;
+  wrapped_writer &operator=(wrapped_writer const &) = delete;
+
+  template <typename... T>
+  void print(fmt::format_string<T...> fmt, T &&...args) {
+    m_scratch.clear();
+    fmt::format_to(
+        std::back_inserter(m_scratch),
+        fmt,
+        std::forward<T>(args)...);
+    append({m_scratch.data(), m_scratch.size()});
+  }
+
+  void append(std::string_view str) {
+    while (!str.empty()) {
+      std::size_t const space = str.find(' ');
+      if (space == std::string_view::npos) {
+        m_word.append(str.data(), str.data() + str.size());
+        return;
+      }
+      m_word.append(str.data(), str.data() + space);
+      end_word();
+      str.remove_prefix(space + 1);
+    }
+  }
+
+  // writes out whatever is left in the current line
+  void finish() {
+    // with a too long indent, a trailing space doesn't produce an empty line
+    if (!m_layout.too_long_indent() || m_word.size() != 0) {
+      end_word();
+    }
+    if (m_layout.has_word()) {
+      write_line();
+    }
+  }
+
+private:
+  OSTREAM &m_os;
+  wrap_layout m_layout;
+  // the current line, including its indentation
+  fmt::memory_buffer m_line;
+  // the word we are currently reading, which may span several `append` calls
+  fmt::memory_buffer m_word;
+  fmt::memory_buffer m_scratch;
+
+  void start_line() {
+    m_line.clear();
+    m_line.resize(m_layout.indent());
+    std::fill(m_line.begin(), m_line.end(), ' ');
+  }
+
+  void end_word() {
+    bool const had_word = m_layout.has_word();
+    if (m_layout.add_word(m_word.size())) {
+      write_line();
+      start_line();
+    } else if (had_word) {
+      m_line.push_back(' ');
+    }
+    m_line.append(m_word.begin(), m_word.end());
+    m_word.clear();
+  }
+
+  void write_line() {
+    m_line.push_back('\n');
+    m_os.write(m_line.data(), static_cast<std::streamsize>(m_line.size()));
+  }
+};
+
+// Computes the number of bytes `wrapped_writer` writes for a text, from the
+// lengths of its space separated words alone.
+class wrapped_size {
+public:
+  wrapped_size(
+      std::size_t first_indent,
+      std::size_t rest_indent,
+      std::size_t column)
+      : m_layout(first_indent, rest_indent, column) {}
+
+  // adds a word of `len` characters, followed by a space
+  void add_word(std::size_t len) {
+    std::size_t const line_size = m_layout.line_size();
+    if (m_layout.add_word(len)) {
+      m_size += line_size;
+    }
+  }
+
+  // adds the text after the last space, of `len` characters, and returns the
+  // total size
+  std::size_t finish(std::size_t len) {
+    if (!m_layout.too_long_indent() || len != 0) {
+      add_word(len);
+    }
+    if (m_layout.has_word()) {
+      m_size += m_layout.line_size();
+    }
+    return m_size;
+  }
+
+private:
+  wrap_layout m_layout;
+  std::size_t m_size{};
+};
+
+#endif // WRAPPED_WRITER_HPP
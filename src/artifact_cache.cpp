@@ -0,0 +1,223 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fmt/os.h>
+#include <fstream>
+#include <libassert/assert.hpp>
+#include <linux/fs.h>
+#include <sstream>
+#include <sys/ioctl.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+#include "artifact_cache.hpp"
+
+// forward declarations
+std::string names_cache_key(design_config const &config);
+std::string codec_cache_key(design_config const &config);
+std::string
+spef_cache_key(std::string_view name, design_config const &config);
+std::uint64_t fnv1a_hash(std::string_view str);
+void share_file(std::string const &from, std::string const &to);
+
+namespace {
+// the first part of every key, changed when the files change for the same
+// config, so that the files of older versions aren't found anymore
+constexpr std::string_view CACHE_VERSION{"gen_design-2"};
+
+[[noreturn]] void throw_errno(std::string const &what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+} // namespace
+
+// block.v doesn't draw any random numbers, so it doesn't depend on the seed
+std::string block_verilog_cache_key(design_config const &config) {
+  return fmt::format(
+      "{} block.v num_nets={} num_cols={} {} {}",
+      CACHE_VERSION,
+      config.num_nets,
+      config.num_cols,
+      names_cache_key(config),
+      codec_cache_key(config));
+}
+
+std::string top_verilog_cache_key(design_config const &config) {
+  return fmt::format(
+      "{} top.v num_blocks={} num_cols={} {} {}",
+      CACHE_VERSION,
+      config.num_blocks,
+      config.num_cols,
+      names_cache_key(config),
+      codec_cache_key(config));
+}
+
+std::string block_spef_cache_key(design_config const &config) {
+  return fmt::format(
+      "{} num_nets={}",
+      spef_cache_key("block.spef", config),
+      config.num_nets);
+}
+
+std::string top_spef_cache_key(design_config const &config) {
+  std::string key = fmt::format(
+      "{} num_blocks={}",
+      spef_cache_key("top.spef", config),
+      config.num_blocks);
+  // the draws of block.spef come first
+  if (config.rng == rng_mode::SEQUENTIAL) {
+    key += fmt::format(" num_nets={}", config.num_nets);
+  }
+  return key;
+}
+
+artifact_cache::artifact_cache(std::string dir) : m_dir(std::move(dir)) {
+  std::filesystem::create_directories(m_dir);
+}
+
+std::optional<artifact_cache::entry>
+artifact_cache::fetch(std::string const &key, std::string const &path) const {
+  std::string const dir = entry_dir(key);
+  std::ifstream in(dir + "/entry");
+  std::string stored_key;
+  entry e;
+  if (!std::getline(in, stored_key) || stored_key != key
+      || !(in >> e.m_uncompressed_size >> e.m_end_gen)) {
+    return std::nullopt;
+  }
+  std::filesystem::remove(path);
+  share_file(dir + "/file", path);
+  e.m_size = std::filesystem::file_size(path);
+  return e;
+}
+
+// The entry is put together in a directory of its own, which is renamed into
+// place once it is complete, so that a run killed in the middle doesn't leave
+// a partial file in the cache.
+void artifact_cache::store(
+    std::string const &key,
+    std::string const &path,
+    std::uint64_t uncompressed_size,
+    std::mt19937_64 const &end_gen) const {
+  std::string const dir = entry_dir(key);
+  if (std::filesystem::exists(dir)) {
+    return;
+  }
+  std::string const tmp_dir = fmt::format("{}.tmp.{}", dir, ::getpid());
+  std::filesystem::remove_all(tmp_dir);
+  std::filesystem::create_directory(tmp_dir);
+  share_file(path, tmp_dir + "/file");
+  {
+    std::ostringstream gen_state;
+    gen_state << end_gen;
+    auto out = fmt::output_file(tmp_dir + "/entry");
+    out.print(
+        "{}\n{}\n{}\n",
+        key,
+        uncompressed_size,
+        std::move(gen_state).str());
+  }
+  // fails if another run stored it first
+  std::error_code ec;
+  std::filesystem::rename(tmp_dir, dir, ec);
+  if (ec) {
+    std::filesystem::remove_all(tmp_dir);
+  }
+}
+
+std::string artifact_cache::entry_dir(std::string const &key) const {
+  return fmt::format("{}/{:016x}", m_dir, fnv1a_hash(key));
+}
+
+// all the names, of which each file only uses some, since they rarely change
+std::string names_cache_key(design_config const &config) {
+  return fmt::format(
+      "names={} {} {} {} {} {} {} {} {} {}",
+      config.block_name,
+      config.top_name,
+      config.block_prefix,
+      config.cell_prefix,
+      config.net_prefix,
+      config.lib_cell_name,
+      config.lib_cell_inp_pin,
+      config.lib_cell_out_pin,
+      config.lib_leaf_cell_name,
+      config.lib_leaf_cell_d_pin);
+}
+
+// The compressed bytes depend on the level, and on whether the file is
+// compressed in parallel, but not on the number of threads that do it.
+std::string codec_cache_key(design_config const &config) {
+  switch (config.codec) {
+  case output_codec::NONE:
+    return "compress=none";
+  case output_codec::GZIP:
+  case output_codec::ZSTD:
+    return fmt::format(
+        "compress={} level={} parallel={}",
+        config.codec == output_codec::GZIP ? "gzip" : "zstd",
+        config.compress_level,
+        config.compress_threads > 1);
+  }
+  UNREACHABLE();
+}
+
+// What both SPEF files depend on. Without `SOURCE_DATE_EPOCH`, the *DATE of a
+// cached file is the date of the run that wrote it.
+std::string
+spef_cache_key(std::string_view name, design_config const &config) {
+  return fmt::format(
+      "{} {} seed={} rng={} num_ccaps={} name_map={} quantize_caps={} "
+      "min_cap_val={} max_cap_val={} date={} {} {}",
+      CACHE_VERSION,
+      name,
+      config.seed,
+      config.rng == rng_mode::COUNTER ? "counter" : "sequential",
+      config.min_num_ccaps,
+      config.name_map,
+      config.quantize_caps,
+      config.min_cap_val,
+      config.max_cap_val,
+      config.source_date_epoch ? fmt::format("{}", *config.source_date_epoch)
+                               : "any",
+      names_cache_key(config),
+      codec_cache_key(config));
+}
+
+// the 64-bit FNV-1a hash, which is the same on every platform, unlike
+// `std::hash`
+std::uint64_t fnv1a_hash(std::string_view str) {
+  std::uint64_t hash = 0xcbf2'9ce4'8422'2325;
+  for (char const ch : str) {
+    hash ^= static_cast<unsigned char>(ch);
+    hash *= 0x0000'0100'0000'01b3;
+  }
+  return hash;
+}
+
+// Creates `to` as a reflink of `from`, which shares its blocks until either is
+// written to, or, where the file system can't, as a hard link, or, across file
+// systems, as a copy.
+void share_file(std::string const &from, std::string const &to) {
+  int const from_fd = ::open(from.c_str(), O_RDONLY);
+  if (from_fd < 0) {
+    throw_errno("open " + from);
+  }
+  int const to_fd = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (to_fd < 0) {
+    ::close(from_fd);
+    throw_errno("open " + to);
+  }
+  bool const cloned = ::ioctl(to_fd, FICLONE, from_fd) == 0;
+  ::close(to_fd);
+  ::close(from_fd);
+  if (cloned) {
+    return;
+  }
+  std::filesystem::remove(to);
+  if (::link(from.c_str(), to.c_str()) == 0) {
+    return;
+  }
+  std::filesystem::copy_file(from, to);
+}
@@ -0,0 +1,171 @@
+#include <filesystem>
+#include <fmt/format.h>
+#include <fmt/os.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <string>
+#include <utility>
+
+#include "checkpoint.hpp"
+
+// forward declarations
+std::string checkpoint_config(design_config const &config);
+std::string rng_state(std::mt19937_64 const &gen);
+
+namespace {
+// the first line of a checkpoint file, changed when its format changes
+constexpr std::string_view CHECKPOINT_VERSION{"gen_design checkpoint 1"};
+} // namespace
+
+std::string checkpoint_path(std::string const &path) {
+  return path + ".checkpoint";
+}
+
+// The checkpoint file is made of `<key> <value>` lines, in this order:
+//   config <checkpoint_config>
+//   next_idx <m_next_idx>
+//   offset <m_offset>
+//   done <0 or 1>
+//   start_gen <the state of m_start_gen>
+//   end_gen <the state of m_end_gen>
+std::optional<checkpoint>
+read_checkpoint(std::string const &path, design_config const &config) {
+  std::string const filename = checkpoint_path(path);
+  std::ifstream in(filename);
+  if (!in) {
+    return std::nullopt;
+  }
+  auto const invalid = [&filename](std::string_view what) {
+    return std::runtime_error(fmt::format("{}: {}", filename, what));
+  };
+  // reads the value of the next line, which must be `key`
+  auto const read_line = [&](std::string_view key) {
+    std::string line;
+    if (!std::getline(in, line) || !line.starts_with(key)
+        || line.size() <= key.size() || line[key.size()] != ' ') {
+      throw invalid(fmt::format("expected {}", key));
+    }
+    return line.substr(key.size() + 1);
+  };
+
+  std::string version;
+  if (!std::getline(in, version) || version != CHECKPOINT_VERSION) {
+    throw invalid("not a checkpoint of this version of gen_design");
+  }
+  if (read_line("config") != checkpoint_config(config)) {
+    throw invalid("the checkpoint is from another config");
+  }
+  // the values, in the order of the lines
+  std::string values;
+  for (std::string_view const key :
+       {"next_idx", "offset", "done", "start_gen", "end_gen"}) {
+    values += read_line(key);
+    values += ' ';
+  }
+  checkpoint c;
+  std::istringstream fields(values);
+  fields >> c.m_next_idx >> c.m_offset >> c.m_done >> c.m_start_gen
+      >> c.m_end_gen;
+  if (!fields) {
+    throw invalid("invalid values");
+  }
+  // e.g. a file written again since, or removed
+  std::error_code ec;
+  std::uintmax_t const size = std::filesystem::file_size(path, ec);
+  if (ec || size < c.m_offset) {
+    throw invalid(fmt::format("{} is shorter than its checkpoint", path));
+  }
+  return c;
+}
+
+checkpointer::checkpointer(std::string path, design_config const &config)
+    : m_path(std::move(path)),
+      m_config(config),
+      m_enabled(config.checkpoint_interval.count() > 0),
+      m_next_save(
+          std::chrono::steady_clock::now() + config.checkpoint_interval) {
+  if (config.resume) {
+    m_resumed = read_checkpoint(m_path, config);
+  }
+}
+
+void checkpointer::save(std::size_t next_idx, std::uint64_t offset) {
+  checkpoint c;
+  c.m_next_idx = next_idx;
+  c.m_offset = offset;
+  c.m_start_gen = m_start_gen;
+  write(c);
+  m_next_save =
+      std::chrono::steady_clock::now() + m_config.checkpoint_interval;
+}
+
+void checkpointer::finish(
+    std::uint64_t offset,
+    std::mt19937_64 const &end_gen) {
+  if (!m_enabled) {
+    return;
+  }
+  checkpoint c;
+  c.m_offset = offset;
+  c.m_done = true;
+  c.m_start_gen = m_start_gen;
+  c.m_end_gen = end_gen;
+  write(c);
+}
+
+// Writes the checkpoint next to its file first, and then renames it, so that
+// a run killed in the middle leaves the previous one.
+void checkpointer::write(checkpoint const &c) {
+  std::string const filename = checkpoint_path(m_path);
+  std::string const tmp_filename = filename + ".tmp";
+  {
+    auto file = fmt::output_file(tmp_filename);
+    file.print("{}\n", CHECKPOINT_VERSION);
+    file.print("config {}\n", checkpoint_config(m_config));
+    file.print("next_idx {}\n", c.m_next_idx);
+    file.print("offset {}\n", c.m_offset);
+    file.print("done {}\n", c.m_done ? 1 : 0);
+    file.print("start_gen {}\n", rng_state(c.m_start_gen));
+    file.print("end_gen {}\n", rng_state(c.m_end_gen));
+  }
+  std::filesystem::rename(tmp_filename, filename);
+}
+
+// everything the content of the files depends on, but the number of threads,
+// which doesn't change it
+std::string checkpoint_config(design_config const &config) {
+  return fmt::format(
+      "seed={} num_nets={} num_blocks={} num_ccaps={} num_cols={} rng={} "
+      "stream_spef={} name_map={} quantize_caps={} min_cap_val={} "
+      "max_cap_val={} names={} {} {} {} {} {} {} {} {} {}",
+      config.seed,
+      config.num_nets,
+      config.num_blocks,
+      config.min_num_ccaps,
+      config.num_cols,
+      config.rng == rng_mode::COUNTER ? "counter" : "sequential",
+      config.stream_spef,
+      config.name_map,
+      config.quantize_caps,
+      config.min_cap_val,
+      config.max_cap_val,
+      config.block_name,
+      config.top_name,
+      config.block_prefix,
+      config.cell_prefix,
+      config.net_prefix,
+      config.lib_cell_name,
+      config.lib_cell_inp_pin,
+      config.lib_cell_out_pin,
+      config.lib_leaf_cell_name,
+      config.lib_leaf_cell_d_pin);
+}
+
+// the state of `gen`, as space separated numbers
+std::string rng_state(std::mt19937_64 const &gen) {
+  std::ostringstream out;
+  out << gen;
+  return std::move(out).str();
+}
@@ -1,11 +1,135 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <cxxopts.hpp>
+#include <exception>
+#include <fcntl.h>
+#include <filesystem>
 #include <fmt/base.h>
+#include <optional>
+#include <ostream>
 #include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
 #include <thread>
+#include <unistd.h>
+#include <vector>
 
+#include "artifact_cache.hpp"
+#include "checkpoint.hpp"
 #include "design_config.hpp"
 #include "gen_spef.hpp"
 #include "gen_verilog.hpp"
+#include "output_buffer.hpp"
+#include "output_sink.hpp"
+#include "progress.hpp"
+#include "run_stats.hpp"
+
+void print_estimates(design_config const &config) {
+  spef_estimate const block_spef = estimate_block_spef(config);
+  spef_estimate const top_spef = estimate_top_spef(config);
+
+  fmt::println("{}.v: {} bytes", config.block_name, block_verilog_size(config));
+  fmt::println("{}.v: {} bytes", config.top_name, top_verilog_size(config));
+  for (auto const &[name, estimate] :
+       {std::pair{config.block_name, block_spef},
+        std::pair{config.top_name, top_spef}}) {
+    fmt::println(
+        "{}.spef: ~{} bytes ({} bytes don't depend on the random numbers)",
+        name,
+        estimate.m_expected_bytes,
+        estimate.m_fixed_bytes);
+    fmt::println(
+        "{}.spef: ~{:.0f} coupling capacitances, ~{:.2f} per net (at least "
+        "{})",
+        name,
+        estimate.m_num_ccaps,
+        estimate.m_ccaps_per_net,
+        config.min_num_ccaps);
+  }
+
+  // the block and top SPEF models are generated one after the other in
+  // sequential mode, and at the same time in counter mode, while each Verilog
+  // writer holds on to its output buffers
+  std::size_t const num_verilog_buffers =
+      (config.num_threads > 1 ? config.num_threads + 1 : 1) + 1;
+  std::size_t const buffer_bytes =
+      output_buffer<std::ostream>::DEFAULT_FLUSH_SIZE * 5 / 4;
+  std::size_t const model_bytes =
+      config.rng == rng_mode::COUNTER
+          ? block_spef.m_model_bytes + top_spef.m_model_bytes
+          : std::max(block_spef.m_model_bytes, top_spef.m_model_bytes);
+  std::size_t const peak_bytes =
+      model_bytes + num_verilog_buffers * buffer_bytes;
+  fmt::println(
+      "peak memory: ~{:.1f} MiB",
+      static_cast<double>(peak_bytes) / (1 << 20));
+}
+
+// Checks that the file at `path` can be written, before the run rather than
+// at its end, by opening it without truncating it. A file that didn't exist
+// yet is removed again.
+std::error_code check_writable(std::string const &path) {
+  std::error_code ec;
+  bool const existed = std::filesystem::exists(path, ec);
+  int const fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return {errno, std::generic_category()};
+  }
+  ::close(fd);
+  if (!existed) {
+    std::filesystem::remove(path, ec);
+  }
+  return {};
+}
+
+// the signature of the writers of the output files
+using file_writer =
+    void (*)(design_config const &, file_progress &, run_stats &);
+
+// Writes the file at `path` with `write`, unless `cache` has the file of `key`,
+// and then adds it to `cache`. Without `cache`, or with an empty `key`, the
+// file is just written. With `draws`, the file draws from `config.gen`, which
+// is left where `write` leaves it, for the next file.
+void write_cached(
+    file_writer write,
+    artifact_cache const *cache,
+    std::string const &key,
+    std::string const &path,
+    bool draws,
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats) {
+  if (cache == nullptr || key.empty()) {
+    write(config, progress, stats);
+    return;
+  }
+  {
+    phase_timer const fetch(stats, progress.m_name, "cache");
+    if (auto const cached = cache->fetch(key, path)) {
+      if (draws) {
+        config.gen = cached->m_end_gen;
+      }
+      progress.m_bytes_written = cached->m_uncompressed_size;
+      progress.m_compressed_bytes = cached->m_size;
+      progress.m_nets_written = progress.m_total_nets;
+      progress.m_done = true;
+      return;
+    }
+  }
+  write(config, progress, stats);
+  phase_timer const store(stats, progress.m_name, "cache");
+  cache->store(
+      key,
+      path,
+      progress.m_bytes_written,
+      draws ? config.gen : std::mt19937_64());
+}
 
 int main(int argc, char const *const *argv) {
   cxxopts::Options options(
@@ -28,6 +152,117 @@ int main(int argc, char const *const *argv) {
       "s,seed",
       "The seed for the random number generator",
       cxxopts::value<unsigned int>());
+  opt_adder(
+      "j,num_threads",
+      "The number of threads used to write each file (block.v is written in "
+      "parallel, into a memory-mapped file, when more than 1)",
+      cxxopts::value<std::size_t>());
+  opt_adder(
+      "rng",
+      "How the random numbers are drawn: \"sequential\" (one generator, the "
+      "SPEF nets are generated one after the other) or \"counter\" (each "
+      "number is a hash of the seed and of its place in the design, the SPEF "
+      "files and nets are generated in parallel, with the same result for "
+      "any number of threads)",
+      cxxopts::value<std::string>()->default_value("sequential"));
+  opt_adder(
+      "compress",
+      "How the files are compressed: \"none\", \"gzip\" (.gz) or \"zstd\" "
+      "(.zst)",
+      cxxopts::value<std::string>()->default_value("none"));
+  opt_adder(
+      "compress_level",
+      "The compression level, 0 for the default of the codec",
+      cxxopts::value<int>()->default_value("0"));
+  opt_adder(
+      "compress_threads",
+      "The number of threads that compress each file, 0 for the number of "
+      "cores (with more than 1, gzip files are made of independent members "
+      "of 1 MiB of input, like pigz does)",
+      cxxopts::value<std::size_t>()->default_value("0"));
+  opt_adder(
+      "async_io",
+      "Write the files asynchronously with io_uring (or a thread of pwrite "
+      "calls where it isn't available), so that formatting doesn't wait for "
+      "the disk");
+  opt_adder(
+      "direct_io",
+      "Write the files with O_DIRECT, bypassing the page cache, implies "
+      "--async_io (the memory-mapped block.v of -j is still written through "
+      "the page cache)");
+  opt_adder(
+      "block_verilog_path",
+      "Where to write block.v, e.g. a named pipe, or \"-\" for stdout",
+      cxxopts::value<std::string>()->default_value(""));
+  opt_adder(
+      "top_verilog_path",
+      "Where to write top.v",
+      cxxopts::value<std::string>()->default_value(""));
+  opt_adder(
+      "block_spef_path",
+      "Where to write block.spef",
+      cxxopts::value<std::string>()->default_value(""));
+  opt_adder(
+      "top_spef_path",
+      "Where to write top.spef",
+      cxxopts::value<std::string>()->default_value(""));
+  opt_adder(
+      "checkpoint_interval",
+      "The number of seconds between the checkpoints of each file, saved next "
+      "to it as <file>.checkpoint, up to which it is synced to the disk, 0 for "
+      "none (not with --compress, --spef_shards or pipes)",
+      cxxopts::value<unsigned int>()->default_value("0"));
+  opt_adder(
+      "resume",
+      "Carry on from the checkpoints of an interrupted run with the same seed "
+      "and options, truncating each file to its checkpoint, instead of "
+      "starting over");
+  opt_adder(
+      "cache_dir",
+      "A directory of the files of earlier runs, each under a hash of the "
+      "options it depends on, which are reused as reflinks (or hard links) "
+      "instead of being generated again, and where new files are added",
+      cxxopts::value<std::string>()->default_value(""));
+  opt_adder(
+      "stream_spef",
+      "Generate and write the SPEF nets one at a time, keeping only the "
+      "coupling capacitances in memory");
+  opt_adder(
+      "name_map",
+      "Write the SPEF net and instance names as *<index> aliases, declared "
+      "once in a *NAME_MAP section");
+  opt_adder(
+      "quantize_caps",
+      "Draw the capacitances and resistances as whole tenths, which are "
+      "written without formatting floating-point numbers");
+  opt_adder(
+      "spef_shards",
+      "Split block.spef into this many files block.<k>.spef, of ranges of "
+      "nets, written in parallel, with a block_spef_shards.tcl that reads "
+      "them",
+      cxxopts::value<std::size_t>()->default_value("1"));
+  opt_adder(
+      "progress_interval",
+      "The number of seconds between the progress lines printed to stderr, 0 "
+      "for none",
+      cxxopts::value<unsigned int>()->default_value("10"));
+  opt_adder(
+      "status_file",
+      "A JSON file kept up to date with the progress of each file",
+      cxxopts::value<std::string>()->default_value(""));
+  opt_adder(
+      "status_interval",
+      "The number of seconds between the updates of --status_file",
+      cxxopts::value<unsigned int>()->default_value("10"));
+  opt_adder(
+      "stats",
+      "A JSON file to write the wall time, CPU time and memory of each phase "
+      "of the run to, with the size of each file and the config",
+      cxxopts::value<std::string>()->default_value(""));
+  opt_adder(
+      "dry_run",
+      "Don't generate anything, just print the expected size of each file "
+      "and the expected peak memory");
   opt_adder("h,help", "Print this help message");
   auto result = options.parse(argc, argv);
 
@@ -46,21 +281,305 @@ int main(int argc, char const *const *argv) {
   if (result.count("num_ccaps") != 0) {
     config.min_num_ccaps = result["num_ccaps"].as<std::size_t>();
   }
+  if (result.count("num_threads") != 0) {
+    config.num_threads =
+        std::max<std::size_t>(result["num_threads"].as<std::size_t>(), 1);
+  }
+  if (auto const rng = result["rng"].as<std::string>(); rng == "counter") {
+    config.rng = rng_mode::COUNTER;
+  } else if (rng != "sequential") {
+    fmt::println(stderr, "unknown --rng mode: {}", rng);
+    return 1;
+  }
+  if (auto const codec = result["compress"].as<std::string>();
+      codec == "gzip") {
+    config.codec = output_codec::GZIP;
+  } else if (codec == "zstd") {
+    config.codec = output_codec::ZSTD;
+  } else if (codec != "none") {
+    fmt::println(stderr, "unknown --compress codec: {}", codec);
+    return 1;
+  }
+  config.compress_level = result["compress_level"].as<int>();
+  if (auto const [min_level, max_level] = compress_level_range(config.codec);
+      config.codec != output_codec::NONE && config.compress_level != 0
+      && (config.compress_level < min_level
+          || config.compress_level > max_level)) {
+    fmt::println(
+        stderr,
+        "--compress_level of {} must be between {} and {}, or 0 for the "
+        "default",
+        result["compress"].as<std::string>(),
+        min_level,
+        max_level);
+    return 1;
+  }
+  config.compress_threads = result["compress_threads"].as<std::size_t>();
+  if (config.compress_threads == 0) {
+    config.compress_threads =
+        std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  config.direct_io = result.count("direct_io") != 0;
+  config.async_io = config.direct_io || result.count("async_io") != 0;
+  config.spef_shards =
+      std::max<std::size_t>(result["spef_shards"].as<std::size_t>(), 1);
+  config.block_verilog_path = result["block_verilog_path"].as<std::string>();
+  config.top_verilog_path = result["top_verilog_path"].as<std::string>();
+  config.block_spef_path = result["block_spef_path"].as<std::string>();
+  config.top_spef_path = result["top_spef_path"].as<std::string>();
+  auto const num_stdout_files = std::ranges::count(
+      std::array{
+          config.block_verilog_path,
+          config.top_verilog_path,
+          config.block_spef_path,
+          config.top_spef_path},
+      "-");
+  if (config.spef_shards > 1 && !config.block_spef_path.empty()) {
+    fmt::println(stderr, "--block_spef_path can't be used with --spef_shards");
+    return 1;
+  }
+  if (num_stdout_files > 1) {
+    fmt::println(stderr, "only one file can be written to stdout (\"-\")");
+    return 1;
+  }
+  if (result["status_interval"].as<unsigned int>() == 0) {
+    fmt::println(stderr, "--status_interval must be at least 1");
+    return 1;
+  }
+  if (auto const status_path = result["status_file"].as<std::string>();
+      !status_path.empty()) {
+    if (auto const ec = check_writable(status_path)) {
+      fmt::println(
+          stderr,
+          "can't write --status_file {}: {}",
+          status_path,
+          ec.message());
+      return 1;
+    }
+  }
+  // the stats are only written at the end, of which a failure would lose them
+  if (auto const stats_path = result["stats"].as<std::string>();
+      !stats_path.empty()) {
+    if (auto const ec = check_writable(stats_path)) {
+      fmt::println(
+          stderr,
+          "can't write --stats {}: {}",
+          stats_path,
+          ec.message());
+      return 1;
+    }
+  }
+  config.checkpoint_interval =
+      std::chrono::seconds(result["checkpoint_interval"].as<unsigned int>());
+  config.resume = result.count("resume") != 0;
+  if (config.checkpoint_interval.count() > 0 || config.resume) {
+    // the checkpoints are offsets in the files as they are written
+    if (config.codec != output_codec::NONE) {
+      fmt::println(
+          stderr,
+          "--checkpoint_interval and --resume can't be used with --compress");
+      return 1;
+    }
+    if (config.spef_shards > 1) {
+      fmt::println(
+          stderr,
+          "--checkpoint_interval and --resume can't be used with "
+          "--spef_shards");
+      return 1;
+    }
+    if (num_stdout_files != 0) {
+      fmt::println(
+          stderr,
+          "--checkpoint_interval and --resume can't write to stdout");
+      return 1;
+    }
+  }
+  config.cache_dir = result["cache_dir"].as<std::string>();
+  config.stream_spef = result.count("stream_spef") != 0;
+  config.name_map = result.count("name_map") != 0;
+  config.quantize_caps = result.count("quantize_caps") != 0;
   if (result.count("seed") != 0) {
     config.seed = result["seed"].as<unsigned int>();
   } else {
     config.seed = std::random_device{}();
   }
-  config.init_rand();
+  // https://reproducible-builds.org/specs/source-date-epoch/
+  if (char const *const epoch = std::getenv("SOURCE_DATE_EPOCH")) {
+    std::time_t date{};
+    char const *const epoch_end = epoch + std::strlen(epoch);
+    if (auto const [ptr, ec] = std::from_chars(epoch, epoch_end, date);
+        ec != std::errc{} || ptr != epoch_end) {
+      fmt::println(stderr, "invalid SOURCE_DATE_EPOCH: {}", epoch);
+      return 1;
+    }
+    config.source_date_epoch = date;
+  }
 
-  std::jthread block_verilog(write_block_verilog, std::ref(config));
-  std::jthread top_verilog(write_top_verilog, std::ref(config));
-  // we can't generate block and top SPEF in parallel, because it messes up the
-  // random number generator
-  std::jthread spef([&config]() {
-    write_block_spef(std::ref(config));
-    write_top_spef(std::ref(config));
-  });
+  if (result.count("dry_run") != 0) {
+    print_estimates(config);
+    return 0;
+  }
+
+  std::array const output_paths{
+      output_path(config.block_verilog_path, config.block_name + ".v", config),
+      output_path(config.top_verilog_path, config.top_name + ".v", config),
+      output_path(config.block_spef_path, config.block_name + ".spef", config),
+      output_path(config.top_spef_path, config.top_name + ".spef", config)};
+  if (config.checkpoint_interval.count() > 0 || config.resume) {
+    for (std::string const &path : output_paths) {
+      if (!seekable_output(path)) {
+        fmt::println(
+            stderr,
+            "--checkpoint_interval and --resume can't write to a pipe: {}",
+            path);
+        return 1;
+      }
+    }
+  }
+  // before anything is written, rather than in the writers
+  if (config.resume) {
+    try {
+      for (std::string const &path : output_paths) {
+        read_checkpoint(path, config);
+      }
+    } catch (std::runtime_error const &e) {
+      fmt::println(stderr, "can't resume: {}", e.what());
+      return 1;
+    }
+  }
+
+  // the messages would be mixed with the file
+  config.init_rand(num_stdout_files != 0 ? stderr : stdout);
+
+  run_stats stats;
+  bool const compressed = config.codec != output_codec::NONE;
+  file_progress block_verilog_progress(
+      output_paths[0],
+      0,
+      block_verilog_size(config),
+      compressed);
+  file_progress top_verilog_progress(
+      output_paths[1],
+      0,
+      top_verilog_size(config),
+      compressed);
+  // all the shards count as one file
+  file_progress block_spef_progress(
+      config.spef_shards > 1
+          ? output_file_name(config.block_name + ".*.spef", config)
+          : output_paths[2],
+      config.num_nets,
+      0,
+      compressed);
+  file_progress top_spef_progress(
+      output_paths[3],
+      config.num_blocks,
+      0,
+      compressed);
+  std::vector<file_progress const *> const files{
+      &block_verilog_progress,
+      &top_verilog_progress,
+      &block_spef_progress,
+      &top_spef_progress};
+  progress_reporter const reporter(
+      files,
+      std::chrono::seconds(result["progress_interval"].as<unsigned int>()),
+      result["status_file"].as<std::string>(),
+      std::chrono::seconds(result["status_interval"].as<unsigned int>()));
+
+  std::optional<artifact_cache> cache;
+  if (!config.cache_dir.empty()) {
+    try {
+      cache.emplace(config.cache_dir);
+    } catch (std::filesystem::filesystem_error const &e) {
+      fmt::println(stderr, "can't use --cache_dir: {}", e.what());
+      return 1;
+    }
+  }
+  // the keys of the files in the cache, or "" for the files that aren't
+  // cached: the pipes, which can't be linked, and the shards of block.spef
+  std::array<std::string, 4> cache_keys;
+  if (cache) {
+    cache_keys = {
+        block_verilog_cache_key(config),
+        top_verilog_cache_key(config),
+        config.spef_shards > 1 ? "" : block_spef_cache_key(config),
+        top_spef_cache_key(config)};
+    for (std::size_t file_idx = 0; file_idx < cache_keys.size(); ++file_idx) {
+      if (!seekable_output(output_paths[file_idx])) {
+        cache_keys[file_idx].clear();
+      }
+    }
+  }
+  // the error of each file, if it couldn't be written, which is reported once
+  // all the writers are done, since an exception would terminate its thread
+  std::array<std::string, 4> errors;
+  // writes file `file_idx` of `output_paths`, or reuses it from the cache, and
+  // returns whether it succeeded
+  auto const write_file = [&](std::size_t file_idx,
+                              file_writer write,
+                              file_progress &progress,
+                              bool draws) {
+    try {
+      write_cached(
+          write,
+          cache ? &*cache : nullptr,
+          cache_keys[file_idx],
+          output_paths[file_idx],
+          draws,
+          config,
+          progress,
+          stats);
+      return true;
+    } catch (std::exception const &e) {
+      errors[file_idx] = e.what();
+      return false;
+    }
+  };
+
+  {
+    std::jthread block_verilog([&] {
+      write_file(0, write_block_verilog, block_verilog_progress, false);
+    });
+    std::jthread top_verilog([&] {
+      write_file(1, write_top_verilog, top_verilog_progress, false);
+    });
+    if (config.rng == rng_mode::COUNTER) {
+      std::jthread block_spef([&] {
+        write_file(2, write_block_spef, block_spef_progress, false);
+      });
+      std::jthread top_spef([&] {
+        write_file(3, write_top_spef, top_spef_progress, false);
+      });
+    } else {
+      // we can't generate block and top SPEF in parallel, because it messes up
+      // the random number generator
+      std::jthread spef([&]() {
+        // top.spef draws after block.spef
+        if (write_file(2, write_block_spef, block_spef_progress, true)) {
+          write_file(3, write_top_spef, top_spef_progress, true);
+        }
+      });
+    }
+  }
+  // the checkpoints are kept, for --resume
+  if (std::ranges::any_of(errors, [](auto const &e) { return !e.empty(); })) {
+    for (std::string const &error : errors) {
+      if (!error.empty()) {
+        fmt::println(stderr, "{}", error);
+      }
+    }
+    return 1;
+  }
+
+  // the run is complete, and can't be resumed anymore
+  for (std::string const &path : output_paths) {
+    std::filesystem::remove(checkpoint_path(path));
+  }
 
+  if (auto const stats_path = result["stats"].as<std::string>();
+      !stats_path.empty()) {
+    stats.write(stats_path, config, files);
+  }
   return 0;
 }
@@ -1,113 +1,512 @@
-#ifdef WRITE_COMPRESSED
-#include <boost/iostreams/device/file.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
-#include <boost/iostreams/filtering_streambuf.hpp>
-#include <ostream>
-#else
-#include <fstream>
-#endif
-
+#include <bit>
+#include <cmath>
+#include <exception>
+#include <fmt/os.h>
 #include <fmt/ostream.h>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
 #include <random>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+#include "checkpoint.hpp"
 #include "design_config.hpp"
+#include "gen_spef.hpp"
+#include "num_digits.hpp"
+#include "output_buffer.hpp"
+#include "output_sink.hpp"
+#include "progress.hpp"
+#include "run_stats.hpp"
 #include "spef.hpp"
 
 // forward declarations
+void write_block_spef_shards(
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats);
+std::string block_spef_shard_name(
+    std::size_t shard_idx,
+    design_config const &config);
+void write_block_spef_shards_tcl(design_config const &config);
+bool resume_spef(
+    checkpointer &checkpoints,
+    design_config const &config,
+    file_progress &progress);
 void gen_header(
     SPEF_file &spef,
     std::string design_name,
     design_config const &config);
 void gen_block_ports(SPEF_file &spef);
 void gen_top_ports(SPEF_file &spef, design_config const &config);
-void gen_block_nets(SPEF_file &spef, design_config const &config);
-void gen_top_nets(SPEF_file &spef, design_config const &config);
+void gen_block_name_map(name_map &map, design_config const &config);
+void gen_top_name_map(name_map &map, design_config const &config);
+void gen_block_nets(
+    SPEF_file &spef,
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats);
+void gen_top_nets(
+    SPEF_file &spef,
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats);
 void gen_block_net_net_ref(
     d_net &net,
     std::size_t net_idx,
+    name_arena &names,
     design_config const &config);
-void gen_top_net_net_ref(d_net &net, std::size_t block_idx);
-void gen_block_net_conn_def(
-    d_net &net,
-    std::size_t net_idx,
-    char pin_delim_ch,
-    design_config const &config);
+void gen_top_net_net_ref(d_net &net, std::size_t block_idx, name_arena &names);
 void gen_top_net_conn_def(
     d_net &net,
     std::size_t block_idx,
+    name_arena &names,
     char hier_div_ch,
     design_config const &config);
-void gen_block_net_cap_sec_ground(
-    d_net &net,
-    std::size_t net_idx,
-    char pin_delim_ch,
-    design_config const &config);
 void gen_top_net_cap_sec_ground(
     d_net &net,
     std::size_t block_idx,
-    char hier_div_ch,
     design_config const &config);
-void gen_block_net_res_sec(
+void gen_top_net_res_sec(
     d_net &net,
+    std::size_t block_idx,
+    design_config const &config);
+void gen_top_net_cap_sec_coupling(
+    coupling_caps &ccaps,
+    design_config const &config);
+template <typename NUM_NODES>
+void gen_cap_sec_coupling(
+    coupling_caps &ccaps,
+    rand_file file,
+    std::size_t num_nets,
+    NUM_NODES num_nodes,
+    design_config const &config);
+void add_coupling_cap_totals(
+    internal_def &internal,
+    design_config const &config,
+    file_progress const &progress,
+    run_stats &stats);
+template <typename NUM_NODES>
+void gen_cap_sec_coupling_counter(
+    coupling_caps &ccaps,
+    rand_file file,
+    std::size_t num_nets,
+    NUM_NODES num_nodes,
+    design_config const &config);
+
+// the initial size of the memory resources of the nets
+static constexpr std::size_t SPEF_SLAB_SIZE{std::size_t{1} << 20};
+
+// node names
+static constexpr std::string_view ALIAS_PREFIX{"*"};
+std::size_t block_net_alias_offset(design_config const &config);
+std::size_t block_num_nodes(std::size_t net_idx);
+static constexpr std::size_t TOP_NUM_NODES{2};
+std::string block_node_name(
     std::size_t net_idx,
+    std::size_t node_idx,
     char pin_delim_ch,
     design_config const &config);
-void gen_top_net_res_sec(
-    d_net &net,
+std::string top_node_name(
     std::size_t block_idx,
+    std::size_t node_idx,
     char hier_div_ch,
     design_config const &config);
-void gen_block_net_cap_sec_coupling(
-    std::vector<d_net> &nets,
-    design_config const &config);
-void gen_top_net_cap_sec_coupling(
-    std::vector<d_net> &nets,
-    design_config const &config);
+
+// streaming
+template <
+    typename OSTREAM,
+    typename GEN_NET,
+    typename NODE_NAME,
+    typename ON_NET_WRITTEN>
+void stream_nets(
+    output_buffer<OSTREAM> &out,
+    coupling_caps const &ccaps,
+    std::size_t first_idx,
+    std::size_t last_idx,
+    GEN_NET gen_net,
+    NODE_NAME node_name,
+    ON_NET_WRITTEN on_net_written,
+    file_progress &progress);
+std::size_t block_net_draws(std::size_t num_nets);
+void skip_draws(design_config const &config, std::size_t num_draws);
+template <typename OSTREAM, typename ON_NET_WRITTEN>
+void stream_block_nets(
+    output_buffer<OSTREAM> &out,
+    char pin_delim_ch,
+    std::size_t first_idx,
+    ON_NET_WRITTEN on_net_written,
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats);
+template <typename OSTREAM, typename ON_NET_WRITTEN>
+void stream_top_nets(
+    output_buffer<OSTREAM> &out,
+    char hier_div_ch,
+    std::size_t first_idx,
+    ON_NET_WRITTEN on_net_written,
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats);
 
 // RNG helpers
+std::size_t gen_num_threads(design_config const &config);
+std::size_t thread_first_idx(
+    std::size_t num_items,
+    std::size_t num_threads,
+    std::size_t thread_idx);
+template <typename FUNC>
+void parallel_for(std::size_t num_items, std::size_t num_threads, FUNC func);
+template <typename FUNC>
+void timed_parallel_for(
+    std::size_t num_items,
+    std::size_t num_threads,
+    run_stats &stats,
+    std::string const &file,
+    std::string_view phase,
+    FUNC func);
+template <typename FUNC>
+void run_in_threads(std::size_t num_items, std::size_t num_threads, FUNC func);
+void init_nets(
+    internal_def &internal,
+    std::size_t num_nets,
+    std::size_t num_threads);
 std::uniform_int_distribution<std::size_t>
 get_idx_dist(std::size_t min_idx, std::size_t max_idx);
 std::uniform_real_distribution<double> &get_cap_dist();
-std::string const &
-get_rand_node(conn_sec const &conns, design_config const &config);
-
-void write_block_spef(design_config const &config) {
-#ifdef WRITE_COMPRESSED
-  std::string filename{config.block_name + ".spef.gz"};
-  boost::iostreams::filtering_ostreambuf buf;
-  buf.push(boost::iostreams::gzip_compressor());
-  buf.push(boost::iostreams::file_sink(filename));
-  std::ostream os(&buf);
-#else
-  std::string filename{config.block_name + ".spef"};
-  std::ofstream os(filename);
-#endif
+
+// estimation helpers
+std::size_t spef_head_size(SPEF_file const &spef);
+std::size_t name_map_size(name_map const &map);
+double ccaps_added_per_net(design_config const &config);
+double expected_missing(std::size_t num_ccaps, double lambda);
+std::size_t heap_size(std::size_t size);
+template <typename T>
+std::size_t vector_heap_size(std::size_t num_elems);
+template <typename T>
+std::size_t arena_size(std::size_t num_elems);
+std::size_t coupling_caps_heap_size(
+    std::size_t num_nets,
+    std::size_t num_ccaps);
+
+// With checkpoints, each file resumes after the last net of its checkpoint,
+// from the random number generator it started from, which is the one it
+// generated the nets from in model mode, and which it skips the draws of the
+// nets already written from in stream mode.
+void write_block_spef(
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats) {
+  if (config.spef_shards > 1) {
+    write_block_spef_shards(config, progress, stats);
+    return;
+  }
+  std::string const path =
+      output_path(config.block_spef_path, config.block_name + ".spef", config);
+  checkpointer checkpoints(path, config);
+  if (resume_spef(checkpoints, config, progress)) {
+    return;
+  }
+  std::optional<checkpoint> const &resumed = checkpoints.resumed();
+  std::size_t const first_idx = resumed ? resumed->m_next_idx : 0;
+  auto const sink = open_output_sink(
+      path,
+      config,
+      resumed ? resumed->m_offset : 0,
+      &progress.m_compressed_bytes);
+  output_buffer out(*sink);
+  out.count_bytes(progress.m_bytes_written);
+  std::size_t next_idx = first_idx;
+  auto const on_net_written = [&] {
+    checkpoints.save_if_due(++next_idx, out, *sink);
+  };
+  phase_timer const total(stats, progress.m_name, "total");
 
   SPEF_file spef;
   gen_header(spef, config.block_name, config);
   gen_block_ports(spef);
-  gen_block_nets(spef, config);
-  spef.write(os);
-}
-
-void write_top_spef(design_config const &config) {
-#ifdef WRITE_COMPRESSED
-  std::string filename{config.top_name + ".spef.gz"};
-  boost::iostreams::filtering_ostreambuf buf;
-  buf.push(boost::iostreams::gzip_compressor());
-  buf.push(boost::iostreams::file_sink(filename));
-  std::ostream os(&buf);
-#else
-  std::string filename{config.top_name + ".spef"};
-  std::ofstream os(filename);
-#endif
+  if (config.name_map) {
+    gen_block_name_map(spef.m_name_map, config);
+  }
+  if (!resumed) {
+    spef.write_head(out);
+  }
+  if (config.stream_spef) {
+    stream_block_nets(
+        out,
+        spef.m_header_def.m_pin_delim.to_char(),
+        first_idx,
+        on_net_written,
+        config,
+        progress,
+        stats);
+  } else {
+    gen_block_nets(spef, config, progress, stats);
+    phase_timer const write(stats, progress.m_name, "write");
+    progress_batch written(progress.m_nets_written);
+    spef.m_internal_def.write(out, first_idx, config.num_nets, [&] {
+      written.add();
+      on_net_written();
+    });
+  }
+  checkpoints.finish(out, *sink, config.gen);
+  out.flush();
+  sink->close();
+  progress.m_done = true;
+}
+
+void write_top_spef(
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats) {
+  std::string const path =
+      output_path(config.top_spef_path, config.top_name + ".spef", config);
+  checkpointer checkpoints(path, config);
+  if (resume_spef(checkpoints, config, progress)) {
+    return;
+  }
+  std::optional<checkpoint> const &resumed = checkpoints.resumed();
+  std::size_t const first_idx = resumed ? resumed->m_next_idx : 0;
+  auto const sink = open_output_sink(
+      path,
+      config,
+      resumed ? resumed->m_offset : 0,
+      &progress.m_compressed_bytes);
+  output_buffer out(*sink);
+  out.count_bytes(progress.m_bytes_written);
+  std::size_t next_idx = first_idx;
+  auto const on_net_written = [&] {
+    checkpoints.save_if_due(++next_idx, out, *sink);
+  };
+  phase_timer const total(stats, progress.m_name, "total");
 
   SPEF_file spef;
   gen_header(spef, config.top_name, config);
   gen_top_ports(spef, config);
-  gen_top_nets(spef, config);
-  spef.write(os);
+  if (config.name_map) {
+    gen_top_name_map(spef.m_name_map, config);
+  }
+  if (!resumed) {
+    spef.write_head(out);
+  }
+  if (config.stream_spef) {
+    stream_top_nets(
+        out,
+        spef.m_header_def.m_hier_div.to_char(),
+        first_idx,
+        on_net_written,
+        config,
+        progress,
+        stats);
+  } else {
+    gen_top_nets(spef, config, progress, stats);
+    phase_timer const write(stats, progress.m_name, "write");
+    progress_batch written(progress.m_nets_written);
+    spef.m_internal_def.write(out, first_idx, config.num_blocks, [&] {
+      written.add();
+      on_net_written();
+    });
+  }
+  checkpoints.finish(out, *sink, config.gen);
+  out.flush();
+  sink->close();
+  progress.m_done = true;
+}
+
+// Sets up a SPEF file that resumes from its checkpoint, if any: the random
+// number generator goes back to where the file started, or, when the file is
+// done, to where it finished, for the next file. Returns whether it is done.
+bool resume_spef(
+    checkpointer &checkpoints,
+    design_config const &config,
+    file_progress &progress) {
+  std::optional<checkpoint> const &resumed = checkpoints.resumed();
+  // in counter mode, the files don't draw from `config.gen`, and run at the
+  // same time
+  bool const sequential = config.rng == rng_mode::SEQUENTIAL;
+  if (resumed) {
+    progress.m_bytes_written = resumed->m_offset;
+    progress.m_nets_written = resumed->m_next_idx;
+    if (resumed->m_done) {
+      if (sequential) {
+        config.gen = resumed->m_end_gen;
+      }
+      progress.m_done = true;
+      return true;
+    }
+    if (sequential) {
+      config.gen = resumed->m_start_gen;
+    }
+  }
+  if (sequential) {
+    checkpoints.start(config.gen);
+  }
+  return false;
+}
+
+// Writes the nets of the block into `config.spef_shards` files
+// block.<k>.spef, of contiguous ranges of nets, one thread per file. Each shard
+// is a complete SPEF file, with the header, the ports and the name map of
+// block.spef, followed by its nets, so that the nets of the shards, in order,
+// are those of block.spef. The coupling capacitances are generated for the
+// whole block, and, as in block.spef, each one is written in the *CAP section
+// of both its nets: one between two shards is in both of them, with the same
+// value and node names, which the tool matches when it reads the shards
+// together (see `write_block_spef_shards_tcl`).
+void write_block_spef_shards(
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats) {
+  phase_timer const total(stats, progress.m_name, "total");
+  SPEF_file spef;
+  gen_header(spef, config.block_name, config);
+  gen_block_ports(spef);
+  if (config.name_map) {
+    gen_block_name_map(spef.m_name_map, config);
+  }
+  char const pin_delim_ch = spef.m_header_def.m_pin_delim.to_char();
+  std::size_t const num_shards = config.spef_shards;
+
+  // writes shard `shard_idx`, whose nets `write_nets(out, first_idx,
+  // last_idx)` writes
+  auto const write_shard = [&](std::size_t shard_idx, auto write_nets) {
+    auto const sink = open_output_sink(
+        output_file_name(block_spef_shard_name(shard_idx, config), config),
+        config,
+        0,
+        &progress.m_compressed_bytes);
+    output_buffer out(*sink);
+    out.count_bytes(progress.m_bytes_written);
+    spef.write_head(out);
+    write_nets(
+        out,
+        thread_first_idx(config.num_nets, num_shards, shard_idx),
+        thread_first_idx(config.num_nets, num_shards, shard_idx + 1));
+    out.flush();
+    sink->close();
+  };
+
+  if (config.stream_spef) {
+    // as in `stream_block_nets`, with a copy of the random number generator at
+    // the first net of each shard
+    phase_timer coupling(stats, progress.m_name, "coupling");
+    std::vector<design_config> shard_configs;
+    shard_configs.reserve(num_shards);
+    for (std::size_t shard_idx = 0; shard_idx < num_shards; ++shard_idx) {
+      shard_configs.push_back(config);
+      skip_draws(
+          config,
+          block_net_draws(
+              thread_first_idx(config.num_nets, num_shards, shard_idx + 1))
+              - block_net_draws(
+                  thread_first_idx(config.num_nets, num_shards, shard_idx)));
+    }
+    auto const coupling_gen = config.gen;
+
+    coupling_caps ccaps;
+    gen_block_net_cap_sec_coupling(ccaps, config);
+    coupling.stop();
+    phase_timer const stream(stats, progress.m_name, "stream");
+    timed_parallel_for(
+        num_shards,
+        num_shards,
+        stats,
+        progress.m_name,
+        "stream",
+        [&](std::size_t shard_idx, std::size_t /*last_shard_idx*/) {
+          design_config const &net_config = shard_configs[shard_idx];
+          write_shard(
+              shard_idx,
+              [&](auto &out, std::size_t first_idx, std::size_t last_idx) {
+                stream_nets(
+                    out,
+                    ccaps,
+                    first_idx,
+                    last_idx,
+                    [&](d_net &net, std::size_t net_idx, name_arena &names) {
+                      gen_block_net_net_ref(net, net_idx, names, net_config);
+                      gen_block_net_conn_def(
+                          net,
+                          net_idx,
+                          names,
+                          pin_delim_ch,
+                          net_config);
+                      gen_block_net_cap_sec_ground(net, net_idx, net_config);
+                      gen_block_net_res_sec(net, net_idx, net_config);
+                    },
+                    [&](std::size_t net_idx, std::size_t node_idx) {
+                      return block_node_name(
+                          net_idx,
+                          node_idx,
+                          pin_delim_ch,
+                          config);
+                    },
+                    [] {},
+                    progress);
+              });
+        });
+    ASSERT(
+        shard_configs.back().gen == coupling_gen,
+        "unexpected number of draws");
+  } else {
+    gen_block_nets(spef, config, progress, stats);
+    phase_timer const write(stats, progress.m_name, "write");
+    timed_parallel_for(
+        num_shards,
+        num_shards,
+        stats,
+        progress.m_name,
+        "write",
+        [&](std::size_t shard_idx, std::size_t /*last_shard_idx*/) {
+          write_shard(
+              shard_idx,
+              [&](auto &out, std::size_t first_idx, std::size_t last_idx) {
+                progress_batch written(progress.m_nets_written);
+                spef.m_internal_def.write(
+                    out,
+                    first_idx,
+                    last_idx,
+                    [&written] { written.add(); });
+              });
+        });
+  }
+  write_block_spef_shards_tcl(config);
+  progress.m_done = true;
+}
+
+// "block.<k>.spef"
+std::string block_spef_shard_name(
+    std::size_t shard_idx,
+    design_config const &config) {
+  return fmt::format("{}.{}.spef", config.block_name, shard_idx);
+}
+
+// Writes <block>_spef_shards.tcl, which reads the shards into every block
+// instance, like example.tcl reads block.spef, with a single
+// `read_parasitics`, so that the coupling capacitances between the shards are
+// matched.
+void write_block_spef_shards_tcl(design_config const &config) {
+  auto out = fmt::output_file(config.block_name + "_spef_shards.tcl");
+  out.print(
+      "# The {} shards of {}.spef, written by gen_design --spef_shards {}.\n"
+      "# They are read together, so that the coupling capacitances between "
+      "their\n"
+      "# nets are matched.\n"
+      "read_parasitics -format SPEF -path [get_cells] {{\n",
+      config.spef_shards,
+      config.block_name,
+      config.spef_shards);
+  for (std::size_t shard_idx = 0; shard_idx < config.spef_shards;
+       ++shard_idx) {
+    out.print(
+        "  ./{}\n",
+        output_file_name(block_spef_shard_name(shard_idx, config), config));
+  }
+  out.print("}}\n");
 }
 
 void gen_header(
@@ -117,13 +516,17 @@ void gen_header(
   spef.m_header_def.m_SPEF_version = "IEEE 1481-1999";
   spef.m_header_def.m_design_name = std::move(design_name);
   {
-    std::time_t now = std::time(nullptr);
+    // a fixed date is in UTC, like the reproducible builds that set
+    // `SOURCE_DATE_EPOCH`, and the current date in local time
+    std::time_t const date =
+        config.source_date_epoch.value_or(std::time(nullptr));
     std::array<char, 80> date_buf{};
     if (std::strftime(
             date_buf.data(),
             date_buf.size(),
             "%a %b %d %H:%M:%S %Y",
-            std::localtime(&now))
+            config.source_date_epoch ? std::gmtime(&date)
+                                     : std::localtime(&date))
         > 0) {
       spef.m_header_def.m_date = date_buf.data();
     }
@@ -156,300 +559,754 @@ void gen_top_ports(SPEF_file &spef, design_config const &config) {
   }
 }
 
-void gen_block_nets(SPEF_file &spef, design_config const &config) {
-  spef.m_internal_def.m_d_nets.resize(config.num_nets);
-  char pin_delim_ch = spef.m_header_def.m_pin_delim.to_char();
-  for (std::size_t net_idx = 0; net_idx < config.num_nets; ++net_idx) {
-    d_net &net = spef.m_internal_def.m_d_nets[net_idx];
-    gen_block_net_net_ref(net, net_idx, config);
-    gen_block_net_conn_def(net, net_idx, pin_delim_ch, config);
-    gen_block_net_cap_sec_ground(net, net_idx, pin_delim_ch, config);
-    gen_block_net_res_sec(net, net_idx, pin_delim_ch, config);
+// The cells u<k> are *<k>, and the nets n<i> follow them (see
+// `block_net_alias_offset`). The port net A isn't mapped.
+void gen_block_name_map(name_map &map, design_config const &config) {
+  if (config.num_nets > 0) {
+    map.m_ranges.push_back({1, 2 * config.num_nets - 1, config.cell_prefix, 1});
+  }
+  if (config.num_nets > 1) {
+    map.m_ranges.push_back(
+        {block_net_alias_offset(config) + 1,
+         config.num_nets - 1,
+         config.net_prefix,
+         1});
   }
-  gen_block_net_cap_sec_coupling(spef.m_internal_def.m_d_nets, config);
 }
 
-void gen_top_nets(SPEF_file &spef, design_config const &config) {
-  spef.m_internal_def.m_d_nets.resize(config.num_blocks);
-  char hier_div_ch = spef.m_header_def.m_hier_div.to_char();
-  for (std::size_t block_idx = 0; block_idx < config.num_blocks; ++block_idx) {
-    d_net &net = spef.m_internal_def.m_d_nets[block_idx];
-    gen_top_net_net_ref(net, block_idx);
-    gen_top_net_conn_def(net, block_idx, hier_div_ch, config);
-    gen_top_net_cap_sec_ground(net, block_idx, hier_div_ch, config);
-    gen_top_net_res_sec(net, block_idx, hier_div_ch, config);
+// The blocks b<i> are *<i>. The ports A<i>, which are also the net names,
+// aren't mapped.
+void gen_top_name_map(name_map &map, design_config const &config) {
+  if (config.num_blocks > 0) {
+    map.m_ranges.push_back({1, config.num_blocks, config.block_prefix, 1});
   }
-  gen_top_net_cap_sec_coupling(spef.m_internal_def.m_d_nets, config);
+}
+
+void gen_block_nets(
+    SPEF_file &spef,
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats) {
+  phase_timer nets(stats, progress.m_name, "nets");
+  init_nets(spef.m_internal_def, config.num_nets, gen_num_threads(config));
+  char pin_delim_ch = spef.m_header_def.m_pin_delim.to_char();
+  std::mutex names_mutex;
+  timed_parallel_for(
+      config.num_nets,
+      gen_num_threads(config),
+      stats,
+      progress.m_name,
+      "nets",
+      [&](std::size_t first_idx, std::size_t last_idx) {
+        name_arena names;
+        progress_batch generated(progress.m_nets_generated);
+        for (std::size_t net_idx = first_idx; net_idx < last_idx; ++net_idx) {
+          d_net &net = spef.m_internal_def.m_d_nets[net_idx];
+          gen_block_net_net_ref(net, net_idx, names, config);
+          gen_block_net_conn_def(net, net_idx, names, pin_delim_ch, config);
+          gen_block_net_cap_sec_ground(net, net_idx, config);
+          gen_block_net_res_sec(net, net_idx, config);
+          generated.add();
+        }
+        std::lock_guard const lock(names_mutex);
+        spef.m_internal_def.m_names.splice(std::move(names));
+      });
+  nets.stop();
+  phase_timer const coupling(stats, progress.m_name, "coupling");
+  gen_block_net_cap_sec_coupling(spef.m_internal_def.m_coupling_caps, config);
+  add_coupling_cap_totals(spef.m_internal_def, config, progress, stats);
+}
+
+void gen_top_nets(
+    SPEF_file &spef,
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats) {
+  phase_timer nets(stats, progress.m_name, "nets");
+  init_nets(spef.m_internal_def, config.num_blocks, gen_num_threads(config));
+  char hier_div_ch = spef.m_header_def.m_hier_div.to_char();
+  std::mutex names_mutex;
+  timed_parallel_for(
+      config.num_blocks,
+      gen_num_threads(config),
+      stats,
+      progress.m_name,
+      "nets",
+      [&](std::size_t first_idx, std::size_t last_idx) {
+        name_arena names;
+        progress_batch generated(progress.m_nets_generated);
+        for (std::size_t block_idx = first_idx; block_idx < last_idx;
+             ++block_idx) {
+          d_net &net = spef.m_internal_def.m_d_nets[block_idx];
+          gen_top_net_net_ref(net, block_idx, names);
+          gen_top_net_conn_def(net, block_idx, names, hier_div_ch, config);
+          gen_top_net_cap_sec_ground(net, block_idx, config);
+          gen_top_net_res_sec(net, block_idx, config);
+          generated.add();
+        }
+        std::lock_guard const lock(names_mutex);
+        spef.m_internal_def.m_names.splice(std::move(names));
+      });
+  nets.stop();
+  phase_timer const coupling(stats, progress.m_name, "coupling");
+  gen_top_net_cap_sec_coupling(spef.m_internal_def.m_coupling_caps, config);
+  add_coupling_cap_totals(spef.m_internal_def, config, progress, stats);
 }
 
 void gen_block_net_net_ref(
     d_net &net,
     std::size_t net_idx,
+    name_arena &names,
     design_config const &config) {
   if (net_idx != 0) {
-    net.m_net_ref = fmt::format("{}{}", config.net_prefix, net_idx);
+    if (config.name_map) {
+      net.m_net_ref = names.format(
+          "{}{}",
+          ALIAS_PREFIX,
+          block_net_alias_offset(config) + net_idx);
+    } else {
+      net.m_net_ref = names.format("{}{}", config.net_prefix, net_idx);
+    }
   } else {
     net.m_net_ref = "A";
   }
 }
 
-void gen_top_net_net_ref(d_net &net, std::size_t block_idx) {
-  net.m_net_ref = fmt::format("A{}", block_idx + 1);
+void gen_top_net_net_ref(d_net &net, std::size_t block_idx, name_arena &names) {
+  net.m_net_ref = names.format("A{}", block_idx + 1);
 }
 
+// Adds the nodes of the net, whose names the capacitances and resistances then
+// refer to.
 void gen_block_net_conn_def(
     d_net &net,
     std::size_t net_idx,
+    name_arena &names,
     char pin_delim_ch,
     design_config const &config) {
+  auto const node_name = [&](std::size_t node_idx) {
+    return names.add(block_node_name(net_idx, node_idx, pin_delim_ch, config));
+  };
+
   if (net_idx == 0) {
-    std::string driver_pin = "A";
-    std::string load_pin = fmt::format(
-        "{}1{}{}",
-        config.cell_prefix,
-        pin_delim_ch,
-        config.lib_cell_inp_pin);
+    net.m_conn_sec.m_conn_def.reserve(2);
     net.m_conn_sec.m_conn_def.emplace_back(
-        conn_def(true, driver_pin, {direction::O}, {}));
+        conn_def(true, node_name(0), {direction::O}, {}));
     net.m_conn_sec.m_conn_def.emplace_back(
-        conn_def(false, load_pin, {direction::I}, {}));
+        conn_def(false, node_name(1), {direction::I}, {}));
     return;
   }
 
-  bool const is_net_to_leaf_cell = net_idx >= config.num_nets / 2;
-
-  std::string driver_pin = fmt::format(
-      "{}{}{}{}",
-      config.cell_prefix,
-      net_idx,
-      pin_delim_ch,
-      config.lib_cell_out_pin);
-  std::string load_pin1 = fmt::format(
-      "{}{}{}{}",
-      config.cell_prefix,
-      net_idx * 2,
-      pin_delim_ch,
-      is_net_to_leaf_cell ? config.lib_leaf_cell_d_pin
-                          : config.lib_cell_inp_pin);
-  std::string load_pin2 = fmt::format(
-      "{}{}{}{}",
-      config.cell_prefix,
-      net_idx * 2 + 1,
-      pin_delim_ch,
-      is_net_to_leaf_cell ? config.lib_leaf_cell_d_pin
-                          : config.lib_cell_inp_pin);
-  std::string internal_node =
-      fmt::format("{}{}{}1", config.net_prefix, net_idx, pin_delim_ch);
-
+  net.m_conn_sec.m_conn_def.reserve(3);
+  net.m_conn_sec.m_internal_node_coord.reserve(1);
   net.m_conn_sec.m_conn_def.emplace_back(
-      conn_def(false, driver_pin, {direction::O}, {}));
+      conn_def(false, node_name(0), {direction::O}, {}));
   net.m_conn_sec.m_conn_def.emplace_back(
-      conn_def(false, load_pin1, {direction::I}, {}));
+      conn_def(false, node_name(1), {direction::I}, {}));
   net.m_conn_sec.m_conn_def.emplace_back(
-      conn_def(false, load_pin2, {direction::I}, {}));
+      conn_def(false, node_name(2), {direction::I}, {}));
   net.m_conn_sec.m_internal_node_coord.emplace_back(
-      internal_node_coord({internal_node, {0, 0}}));
+      internal_node_coord({node_name(3), {0, 0}}));
 }
 
 void gen_top_net_conn_def(
     d_net &net,
     std::size_t block_idx,
+    name_arena &names,
     char hier_div_ch,
     design_config const &config) {
-  std::string driver_pin = fmt::format("A{}", block_idx + 1);
-  std::string load_pin =
-      fmt::format("{}{}{}A", config.block_prefix, block_idx + 1, hier_div_ch);
-  net.m_conn_sec.m_conn_def.emplace_back(
-      conn_def(true, driver_pin, {direction::O}, {}));
-  net.m_conn_sec.m_conn_def.emplace_back(
-      conn_def(false, load_pin, {direction::I}, {}));
+  net.m_conn_sec.m_conn_def.reserve(TOP_NUM_NODES);
+  net.m_conn_sec.m_conn_def.emplace_back(conn_def(
+      true,
+      names.add(top_node_name(block_idx, 0, hier_div_ch, config)),
+      {direction::O},
+      {}));
+  net.m_conn_sec.m_conn_def.emplace_back(conn_def(
+      false,
+      names.add(top_node_name(block_idx, 1, hier_div_ch, config)),
+      {direction::I},
+      {}));
 }
 
 void gen_block_net_cap_sec_ground(
     d_net &net,
     std::size_t net_idx,
-    char pin_delim_ch,
     design_config const &config) {
-  if (net_idx == 0) {
-    std::string driver_pin = "A";
-    std::string load_pin = fmt::format(
-        "{}1{}{}",
-        config.cell_prefix,
-        pin_delim_ch,
-        config.lib_cell_inp_pin);
-    net.m_cap_sec.m_caps.emplace_back(cap(driver_pin, {config.rand_cap()}));
-    net.m_cap_sec.m_caps.emplace_back(cap(load_pin, {config.rand_cap()}));
-    return;
+  conn_sec const &conns = net.m_conn_sec;
+  net.m_cap_sec.m_caps.reserve(conns.num_nodes());
+  for (std::size_t node_idx = 0; node_idx < conns.num_nodes(); ++node_idx) {
+    net.m_cap_sec.add(cap(
+        conns.node_name(node_idx),
+        {config.rand_cap(
+            {rand_file::BLOCK_SPEF,
+             rand_field::GROUND_CAP,
+             net_idx,
+             node_idx})}));
   }
-
-  bool const is_net_to_leaf_cell = net_idx >= config.num_nets / 2;
-
-  std::string driver_pin = fmt::format(
-      "{}{}{}{}",
-      config.cell_prefix,
-      net_idx,
-      pin_delim_ch,
-      config.lib_cell_out_pin);
-  std::string load_pin1 = fmt::format(
-      "{}{}{}{}",
-      config.cell_prefix,
-      net_idx * 2,
-      pin_delim_ch,
-      is_net_to_leaf_cell ? config.lib_leaf_cell_d_pin
-                          : config.lib_cell_inp_pin);
-  std::string load_pin2 = fmt::format(
-      "{}{}{}{}",
-      config.cell_prefix,
-      net_idx * 2 + 1,
-      pin_delim_ch,
-      is_net_to_leaf_cell ? config.lib_leaf_cell_d_pin
-                          : config.lib_cell_inp_pin);
-  std::string internal_node =
-      fmt::format("{}{}{}1", config.net_prefix, net_idx, pin_delim_ch);
-
-  net.m_cap_sec.m_caps.emplace_back(cap(driver_pin, {config.rand_cap()}));
-  net.m_cap_sec.m_caps.emplace_back(cap(load_pin1, {config.rand_cap()}));
-  net.m_cap_sec.m_caps.emplace_back(cap(load_pin2, {config.rand_cap()}));
-  net.m_cap_sec.m_caps.emplace_back(cap(internal_node, {config.rand_cap()}));
 }
 
 void gen_top_net_cap_sec_ground(
     d_net &net,
     std::size_t block_idx,
-    char hier_div_ch,
     design_config const &config) {
-  std::string driver_pin = fmt::format("A{}", block_idx + 1);
-  std::string load_pin =
-      fmt::format("{}{}{}A", config.block_prefix, block_idx + 1, hier_div_ch);
-  net.m_cap_sec.m_caps.emplace_back(cap(driver_pin, {config.rand_cap()}));
-  net.m_cap_sec.m_caps.emplace_back(cap(load_pin, {config.rand_cap()}));
+  conn_sec const &conns = net.m_conn_sec;
+  net.m_cap_sec.m_caps.reserve(conns.num_nodes());
+  for (std::size_t node_idx = 0; node_idx < conns.num_nodes(); ++node_idx) {
+    net.m_cap_sec.add(cap(
+        conns.node_name(node_idx),
+        {config.rand_cap(
+            {rand_file::TOP_SPEF,
+             rand_field::GROUND_CAP,
+             block_idx,
+             node_idx})}));
+  }
 }
 
 void gen_block_net_res_sec(
     d_net &net,
     std::size_t net_idx,
-    char pin_delim_ch,
     design_config const &config) {
+  auto const rand_res = [net_idx, &config](std::size_t res_idx) {
+    return config.rand_cap(
+        {rand_file::BLOCK_SPEF, rand_field::RES, net_idx, res_idx});
+  };
+  conn_sec const &conns = net.m_conn_sec;
+
   if (net_idx == 0) {
-    std::string driver_pin = "A";
-    std::string load_pin = fmt::format(
-        "{}1{}{}",
-        config.cell_prefix,
-        pin_delim_ch,
-        config.lib_cell_inp_pin);
+    net.m_res_sec.m_ress.reserve(1);
     net.m_res_sec.m_ress.emplace_back(
-        res(driver_pin, load_pin, {config.rand_cap()}));
+        res(conns.node_name(0), conns.node_name(1), {rand_res(0)}));
     return;
   }
 
-  bool const is_net_to_leaf_cell = net_idx >= config.num_nets / 2;
-
-  std::string driver_pin = fmt::format(
-      "{}{}{}{}",
-      config.cell_prefix,
-      net_idx,
-      pin_delim_ch,
-      config.lib_cell_out_pin);
-  std::string load_pin1 = fmt::format(
-      "{}{}{}{}",
-      config.cell_prefix,
-      net_idx * 2,
-      pin_delim_ch,
-      is_net_to_leaf_cell ? config.lib_leaf_cell_d_pin
-                          : config.lib_cell_inp_pin);
-  std::string load_pin2 = fmt::format(
-      "{}{}{}{}",
-      config.cell_prefix,
-      net_idx * 2 + 1,
-      pin_delim_ch,
-      is_net_to_leaf_cell ? config.lib_leaf_cell_d_pin
-                          : config.lib_cell_inp_pin);
-  std::string internal_node =
-      fmt::format("{}{}{}1", config.net_prefix, net_idx, pin_delim_ch);
+  net.m_res_sec.m_ress.reserve(3);
+  std::string_view const driver_pin = conns.node_name(0);
+  std::string_view const load_pin1 = conns.node_name(1);
+  std::string_view const load_pin2 = conns.node_name(2);
+  std::string_view const internal_node = conns.node_name(3);
 
   net.m_res_sec.m_ress.emplace_back(
-      res(driver_pin, internal_node, {config.rand_cap()}));
+      res(driver_pin, internal_node, {rand_res(0)}));
   net.m_res_sec.m_ress.emplace_back(
-      res(internal_node, load_pin1, {config.rand_cap()}));
+      res(internal_node, load_pin1, {rand_res(1)}));
   net.m_res_sec.m_ress.emplace_back(
-      res(internal_node, load_pin2, {config.rand_cap()}));
+      res(internal_node, load_pin2, {rand_res(2)}));
 }
 
 void gen_top_net_res_sec(
     d_net &net,
     std::size_t block_idx,
-    char hier_div_ch,
     design_config const &config) {
-  std::string driver_pin = fmt::format("A{}", block_idx + 1);
-  std::string load_pin =
-      fmt::format("{}{}{}A", config.block_prefix, block_idx + 1, hier_div_ch);
-  net.m_res_sec.m_ress.emplace_back(
-      res(driver_pin, load_pin, {config.rand_cap()}));
+  conn_sec const &conns = net.m_conn_sec;
+  net.m_res_sec.m_ress.reserve(1);
+  net.m_res_sec.m_ress.emplace_back(res(
+      conns.node_name(0),
+      conns.node_name(1),
+      {config.rand_cap({rand_file::TOP_SPEF, rand_field::RES, block_idx, 0})}));
 }
 
 void gen_block_net_cap_sec_coupling(
-    std::vector<d_net> &nets,
+    coupling_caps &ccaps,
     design_config const &config) {
-  auto net_idx_dist = get_idx_dist(0, nets.size() - 1);
+  gen_cap_sec_coupling(
+      ccaps,
+      rand_file::BLOCK_SPEF,
+      config.num_nets,
+      block_num_nodes,
+      config);
+}
 
-  std::size_t num_ground_caps = 2;
-  for (std::size_t idx1 = 0; idx1 < nets.size(); ++idx1) {
-    // we already have `num_ground_caps` ground caps
-    ASSERT(
-        nets[idx1].m_cap_sec.m_caps.size() >= num_ground_caps,
-        "fewer than expected ground capacitances",
-        nets[idx1].m_cap_sec.m_caps);
-    while (nets[idx1].m_cap_sec.m_caps.size()
-           < config.min_num_ccaps + num_ground_caps) {
-      fmt::println("size={}", nets[idx1].m_cap_sec.m_caps.size());
+void gen_top_net_cap_sec_coupling(
+    coupling_caps &ccaps,
+    design_config const &config) {
+  gen_cap_sec_coupling(
+      ccaps,
+      rand_file::TOP_SPEF,
+      config.num_blocks,
+      [](std::size_t) { return TOP_NUM_NODES; },
+      config);
+}
+
+// Adds coupling capacitances between random nodes of random nets, until each
+// net has at least `min_num_ccaps` of them. `num_nodes(net_idx)` is the number
+// of nodes of a net.
+template <typename NUM_NODES>
+void gen_cap_sec_coupling(
+    coupling_caps &ccaps,
+    rand_file file,
+    std::size_t num_nets,
+    NUM_NODES num_nodes,
+    design_config const &config) {
+  if (config.rng == rng_mode::COUNTER) {
+    gen_cap_sec_coupling_counter(ccaps, file, num_nets, num_nodes, config);
+    return;
+  }
+  if (num_nets == 0) {
+    ccaps.index(0);
+    return;
+  }
 
+  std::vector<std::size_t> num_ccaps(num_nets);
+  auto net_idx_dist = get_idx_dist(0, num_nets - 1);
+  for (std::size_t idx1 = 0; idx1 < num_nets; ++idx1) {
+    while (num_ccaps[idx1] < config.min_num_ccaps) {
       std::size_t idx2 = net_idx_dist(config.gen);
       // don't generate self-coupling caps
       while (idx1 == idx2) {
         idx2 = net_idx_dist(config.gen);
       }
 
-      d_net &net1 = nets[idx1];
-      d_net &net2 = nets[idx2];
+      std::size_t const node1 =
+          get_idx_dist(0, num_nodes(idx1) - 1)(config.gen);
+      std::size_t const node2 =
+          get_idx_dist(0, num_nodes(idx2) - 1)(config.gen);
+      ccaps.add(idx1, node1, idx2, node2, config.rand_cap());
+      ++num_ccaps[idx1];
+      ++num_ccaps[idx2];
+    }
+  }
+  ccaps.index(num_nets);
+}
+
+// adds the coupling capacitances to the total capacitance of both their nets
+void add_coupling_cap_totals(
+    internal_def &internal,
+    design_config const &config,
+    file_progress const &progress,
+    run_stats &stats) {
+  timed_parallel_for(
+      internal.m_d_nets.size(),
+      gen_num_threads(config),
+      stats,
+      progress.m_name,
+      "coupling",
+      [&internal](std::size_t first_idx, std::size_t last_idx) {
+        for (std::size_t net_idx = first_idx; net_idx < last_idx; ++net_idx) {
+          internal.m_d_nets[net_idx].add_coupling_caps(
+              net_idx,
+              internal.m_coupling_caps);
+        }
+      });
+}
+
+// The same as `gen_cap_sec_coupling`, but with the random numbers of the
+// counter mode, in parallel. The greedy loop above depends on the order of the
+// nets, since each net only adds the capacitances it still misses, so we
+// generate them in two rounds instead:
+// 1. each net adds `min_num_ccaps / 2` capacitances
+// 2. each net that still has fewer than `min_num_ccaps` capacitances adds the
+//    ones it misses
+// Each capacitance is drawn at the index of its net and its place in the net,
+// so the result doesn't depend on the number of threads.
+template <typename NUM_NODES>
+void gen_cap_sec_coupling_counter(
+    coupling_caps &ccaps,
+    rand_file file,
+    std::size_t num_nets,
+    NUM_NODES num_nodes,
+    design_config const &config) {
+  ccaps.m_caps.clear();
+  // a net can't couple with itself
+  if (num_nets < 2) {
+    ccaps.index(num_nets);
+    return;
+  }
 
-      std::string const &node1 = get_rand_node(net1.m_conn_sec, config);
-      std::string const &node2 = get_rand_node(net2.m_conn_sec, config);
-      auto caps = {config.rand_cap()};
-      net1.m_cap_sec.m_caps.emplace_back(node1, node2, caps);
-      net2.m_cap_sec.m_caps.emplace_back(node2, node1, caps);
+  std::size_t const num_threads = gen_num_threads(config);
+  // draws the `idx`-th capacitance that `net_idx` adds
+  auto const draw = [&](std::size_t net_idx, std::size_t idx) {
+    std::size_t other_net_idx = config.counter.index(
+        {file, rand_field::COUPLING_NET, net_idx, idx},
+        num_nets - 1);
+    // skip over `net_idx`
+    if (other_net_idx >= net_idx) {
+      ++other_net_idx;
     }
-    num_ground_caps = 4;
+    std::size_t const node_idx = config.counter.index(
+        {file, rand_field::COUPLING_NODE1, net_idx, idx},
+        num_nodes(net_idx));
+    std::size_t const other_node_idx = config.counter.index(
+        {file, rand_field::COUPLING_NODE2, net_idx, idx},
+        num_nodes(other_net_idx));
+    return coupling_caps::make(
+        net_idx,
+        node_idx,
+        other_net_idx,
+        other_node_idx,
+        config.rand_cap({file, rand_field::COUPLING_CAP, net_idx, idx}));
+  };
+
+  std::size_t const num_first = config.min_num_ccaps / 2;
+  ccaps.m_caps.resize(num_nets * num_first);
+  parallel_for(
+      num_nets,
+      num_threads,
+      [&](std::size_t first_idx, std::size_t last_idx) {
+        for (std::size_t net_idx = first_idx; net_idx < last_idx; ++net_idx) {
+          for (std::size_t idx = 0; idx < num_first; ++idx) {
+            ccaps.m_caps[net_idx * num_first + idx] = draw(net_idx, idx);
+          }
+        }
+      });
+
+  // `num_missing[net_idx]` is the offset of the capacitances that `net_idx`
+  // adds in the second round, after the prefix sum
+  std::vector<std::size_t> num_missing(num_nets + 1, num_first);
+  for (coupling_caps::coupling_cap const &c : ccaps.m_caps) {
+    ++num_missing[c.m_net2];
   }
+  std::size_t offset = ccaps.m_caps.size();
+  for (std::size_t net_idx = 0; net_idx < num_nets; ++net_idx) {
+    std::size_t const num_ccaps = num_missing[net_idx];
+    num_missing[net_idx] = offset;
+    offset += config.min_num_ccaps - std::min(num_ccaps, config.min_num_ccaps);
+  }
+  num_missing[num_nets] = offset;
+
+  ccaps.m_caps.resize(offset);
+  parallel_for(
+      num_nets,
+      num_threads,
+      [&](std::size_t first_idx, std::size_t last_idx) {
+        for (std::size_t net_idx = first_idx; net_idx < last_idx; ++net_idx) {
+          std::size_t idx = num_first;
+          for (std::size_t pos = num_missing[net_idx];
+               pos < num_missing[net_idx + 1];
+               ++pos) {
+            ccaps.m_caps[pos] = draw(net_idx, idx++);
+          }
+        }
+      });
+  ccaps.index(num_nets);
 }
 
-void gen_top_net_cap_sec_coupling(
-    std::vector<d_net> &nets,
+// With a name map, net n<i> is *<offset + i>, right after the cells u<k>.
+// The cells get the smaller indices, since they are written 3 times as often.
+std::size_t block_net_alias_offset(design_config const &config) {
+  return config.num_nets == 0 ? 0 : 2 * config.num_nets - 1;
+}
+
+std::size_t block_num_nodes(std::size_t net_idx) {
+  return net_idx == 0 ? 2 : 4;
+}
+
+// The nodes of a block net are
+//   net 0: A, u1:A
+//   net i: u<i>:Z, u<2i>:A, u<2i + 1>:A, n<i>:1
+// where the loads are leaf cells (u<2i>:D, u<2i + 1>:D) for the second half of
+// the nets. With a name map, the cells and nets are written as their aliases.
+std::string block_node_name(
+    std::size_t net_idx,
+    std::size_t node_idx,
+    char pin_delim_ch,
     design_config const &config) {
-  auto net_idx_dist = get_idx_dist(0, nets.size() - 1);
+  std::string_view const cell_prefix =
+      config.name_map ? ALIAS_PREFIX : config.cell_prefix;
+  std::string_view const net_prefix =
+      config.name_map ? ALIAS_PREFIX : config.net_prefix;
+  std::size_t const net_offset =
+      config.name_map ? block_net_alias_offset(config) : 0;
 
-  std::size_t const num_ground_caps = 2;
-  for (std::size_t idx1 = 0; idx1 < nets.size(); ++idx1) {
-    ASSERT(
-        nets[idx1].m_cap_sec.m_caps.size() >= num_ground_caps,
-        "fewer than expected ground capacitances",
-        nets[idx1].m_cap_sec.m_caps);
-    // we already have `num_ground_caps` ground caps
-    while (nets[idx1].m_cap_sec.m_caps.size()
-           < config.min_num_ccaps + num_ground_caps) {
-      std::size_t idx2 = net_idx_dist(config.gen);
-      // don't generate self-coupling caps
-      while (idx1 == idx2) {
-        idx2 = net_idx_dist(config.gen);
-      }
+  if (net_idx == 0) {
+    if (node_idx == 0) {
+      return "A";
+    }
+    return fmt::format(
+        "{}1{}{}",
+        cell_prefix,
+        pin_delim_ch,
+        config.lib_cell_inp_pin);
+  }
+
+  bool const is_net_to_leaf_cell = net_idx >= config.num_nets / 2;
+  switch (node_idx) {
+  case 0:
+    return fmt::format(
+        "{}{}{}{}",
+        cell_prefix,
+        net_idx,
+        pin_delim_ch,
+        config.lib_cell_out_pin);
+  case 1:
+  case 2:
+    return fmt::format(
+        "{}{}{}{}",
+        cell_prefix,
+        net_idx * 2 + node_idx - 1,
+        pin_delim_ch,
+        is_net_to_leaf_cell ? config.lib_leaf_cell_d_pin
+                            : config.lib_cell_inp_pin);
+  default:
+    return fmt::format(
+        "{}{}{}1",
+        net_prefix,
+        net_offset + net_idx,
+        pin_delim_ch);
+  }
+}
+
+// The nodes of top net i are A<i + 1>, b<i + 1>/A, where b<i + 1> is *<i + 1>
+// with a name map.
+std::string top_node_name(
+    std::size_t block_idx,
+    std::size_t node_idx,
+    char hier_div_ch,
+    design_config const &config) {
+  if (node_idx == 0) {
+    return fmt::format("A{}", block_idx + 1);
+  }
+  return fmt::format(
+      "{}{}{}A",
+      config.name_map ? ALIAS_PREFIX : config.block_prefix,
+      block_idx + 1,
+      hier_div_ch);
+}
+
+// Generates and writes the nets in [first_idx, last_idx) one at a time, reusing
+// a single `d_net` and `name_arena`. `gen_net(net, net_idx, names)` fills in
+// everything but the coupling capacitances, which come from `ccaps`, and
+// `node_name(net_idx, node_idx)` names their nodes. `on_net_written()` is
+// called after each net.
+template <
+    typename OSTREAM,
+    typename GEN_NET,
+    typename NODE_NAME,
+    typename ON_NET_WRITTEN>
+void stream_nets(
+    output_buffer<OSTREAM> &out,
+    coupling_caps const &ccaps,
+    std::size_t first_idx,
+    std::size_t last_idx,
+    GEN_NET gen_net,
+    NODE_NAME node_name,
+    ON_NET_WRITTEN on_net_written,
+    file_progress &progress) {
+  d_net net;
+  name_arena names;
+  progress_batch generated(progress.m_nets_generated);
+  progress_batch written(progress.m_nets_written);
+  for (std::size_t net_idx = first_idx; net_idx < last_idx; ++net_idx) {
+    net.clear();
+    names.clear();
+    gen_net(net, net_idx, names);
+    net.add_coupling_caps(net_idx, ccaps);
+    generated.add();
+    net.write(out, net_idx, ccaps, node_name);
+    written.add();
+    on_net_written();
+  }
+}
+
+// `gen_block_nets` draws the ground capacitances and resistances of all the
+// nets before the coupling capacitances. To generate and write one net at a
+// time, we plan the coupling capacitances first, skipping over the random
+// numbers that come before them, and generate the nets from a copy of the
+// random number generator that still points at those. In counter mode, the
+// order of the draws doesn't matter. The nets before `first_idx`, which a
+// resumed file already has, are skipped.
+template <typename OSTREAM, typename ON_NET_WRITTEN>
+void stream_block_nets(
+    output_buffer<OSTREAM> &out,
+    char pin_delim_ch,
+    std::size_t first_idx,
+    ON_NET_WRITTEN on_net_written,
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats) {
+  phase_timer coupling(stats, progress.m_name, "coupling");
+  design_config const net_config = config;
+  skip_draws(config, block_net_draws(config.num_nets));
+  auto const coupling_gen = config.gen;
+  skip_draws(net_config, block_net_draws(first_idx));
+
+  coupling_caps ccaps;
+  gen_block_net_cap_sec_coupling(ccaps, config);
+  coupling.stop();
+  phase_timer const stream(stats, progress.m_name, "stream");
+  stream_nets(
+      out,
+      ccaps,
+      first_idx,
+      config.num_nets,
+      [&](d_net &net, std::size_t net_idx, name_arena &names) {
+        gen_block_net_net_ref(net, net_idx, names, config);
+        gen_block_net_conn_def(net, net_idx, names, pin_delim_ch, config);
+        gen_block_net_cap_sec_ground(net, net_idx, net_config);
+        gen_block_net_res_sec(net, net_idx, net_config);
+      },
+      [&](std::size_t net_idx, std::size_t node_idx) {
+        return block_node_name(net_idx, node_idx, pin_delim_ch, config);
+      },
+      on_net_written,
+      progress);
+  ASSERT(net_config.gen == coupling_gen, "unexpected number of draws");
+}
+
+// same as `stream_block_nets`, for `gen_top_nets`
+template <typename OSTREAM, typename ON_NET_WRITTEN>
+void stream_top_nets(
+    output_buffer<OSTREAM> &out,
+    char hier_div_ch,
+    std::size_t first_idx,
+    ON_NET_WRITTEN on_net_written,
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats) {
+  phase_timer coupling(stats, progress.m_name, "coupling");
+  design_config const net_config = config;
+  // 2 ground capacitances and 1 resistance per net
+  skip_draws(config, 3 * config.num_blocks);
+  auto const coupling_gen = config.gen;
+  skip_draws(net_config, 3 * first_idx);
+
+  coupling_caps ccaps;
+  gen_top_net_cap_sec_coupling(ccaps, config);
+  coupling.stop();
+  phase_timer const stream(stats, progress.m_name, "stream");
+  stream_nets(
+      out,
+      ccaps,
+      first_idx,
+      config.num_blocks,
+      [&](d_net &net, std::size_t block_idx, name_arena &names) {
+        gen_top_net_net_ref(net, block_idx, names);
+        gen_top_net_conn_def(net, block_idx, names, hier_div_ch, config);
+        gen_top_net_cap_sec_ground(net, block_idx, net_config);
+        gen_top_net_res_sec(net, block_idx, net_config);
+      },
+      [&](std::size_t block_idx, std::size_t node_idx) {
+        return top_node_name(block_idx, node_idx, hier_div_ch, config);
+      },
+      on_net_written,
+      progress);
+  ASSERT(net_config.gen == coupling_gen, "unexpected number of draws");
+}
+
+// the number of random numbers drawn by the first `num_nets` nets of the block:
+// 2 ground capacitances and 1 resistance for net 0, 4 and 3 for the rest
+std::size_t block_net_draws(std::size_t num_nets) {
+  return num_nets == 0 ? 0 : 3 + 7 * (num_nets - 1);
+}
+
+// draws `num_draws` random numbers in sequential mode, to skip over them
+void skip_draws(design_config const &config, std::size_t num_draws) {
+  for (std::size_t draw = 0;
+       config.rng == rng_mode::SEQUENTIAL && draw < num_draws;
+       ++draw) {
+    config.rand_cap();
+  }
+}
+
+// the number of threads that generate the nets of a file, which must be 1 if
+// the random numbers depend on the order of the draws
+std::size_t gen_num_threads(design_config const &config) {
+  return config.rng == rng_mode::COUNTER ? config.num_threads : 1;
+}
+
+// calls `func(first_idx, last_idx)` on `num_threads` contiguous ranges of
+// [0, num_items), each in its own thread
+template <typename FUNC>
+void parallel_for(std::size_t num_items, std::size_t num_threads, FUNC func) {
+  if (num_threads <= 1) {
+    func(0, num_items);
+    return;
+  }
+  run_in_threads(
+      num_items,
+      num_threads,
+      [&func](
+          std::size_t /*thread_idx*/,
+          std::size_t first_idx,
+          std::size_t last_idx) { func(first_idx, last_idx); });
+}
 
-      d_net &net1 = nets[idx1];
-      d_net &net2 = nets[idx2];
+// `parallel_for`, which also times each worker thread `k` as the phase
+// `<phase>/worker<k>` of `file`, so that the stats have the CPU time of every
+// thread. A single range runs on the calling thread, which `phase` times.
+template <typename FUNC>
+void timed_parallel_for(
+    std::size_t num_items,
+    std::size_t num_threads,
+    run_stats &stats,
+    std::string const &file,
+    std::string_view phase,
+    FUNC func) {
+  if (num_threads <= 1) {
+    func(0, num_items);
+    return;
+  }
+  run_in_threads(
+      num_items,
+      num_threads,
+      [&stats, &file, phase, &func](
+          std::size_t thread_idx,
+          std::size_t first_idx,
+          std::size_t last_idx) {
+        phase_timer const worker(
+            stats,
+            file,
+            fmt::format("{}/worker{}", phase, thread_idx));
+        func(first_idx, last_idx);
+      });
+}
 
-      std::string const &node1 = get_rand_node(net1.m_conn_sec, config);
-      std::string const &node2 = get_rand_node(net2.m_conn_sec, config);
-      auto caps = {config.rand_cap()};
-      net1.m_cap_sec.m_caps.emplace_back(node1, node2, caps);
-      net2.m_cap_sec.m_caps.emplace_back(node2, node1, caps);
+// Calls `func(thread_idx, first_idx, last_idx)` in `num_threads` threads, as
+// `parallel_for` splits the items. An exception of a thread, e.g. when a shard
+// can't be written, would terminate the process, so the first one is thrown
+// again here once all the threads are done.
+template <typename FUNC>
+void run_in_threads(std::size_t num_items, std::size_t num_threads, FUNC func) {
+  std::vector<std::exception_ptr> errors(num_threads);
+  {
+    std::vector<std::jthread> workers;
+    for (std::size_t thread_idx = 0; thread_idx < num_threads; ++thread_idx) {
+      workers.emplace_back(
+          [&func, &errors, num_items, num_threads, thread_idx] {
+            try {
+              func(
+                  thread_idx,
+                  thread_first_idx(num_items, num_threads, thread_idx),
+                  thread_first_idx(num_items, num_threads, thread_idx + 1));
+            } catch (...) {
+              errors[thread_idx] = std::current_exception();
+            }
+          });
+    }
+  }
+  for (std::exception_ptr const &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+// the first item of thread `thread_idx` in `parallel_for`
+std::size_t thread_first_idx(
+    std::size_t num_items,
+    std::size_t num_threads,
+    std::size_t thread_idx) {
+  return num_items * thread_idx / num_threads;
+}
+
+// Creates `num_nets` empty nets, whose sections allocate from one
+// `monotonic_buffer_resource` per thread of `parallel_for`, so that the threads
+// don't share a resource, and the model is freed in a few large blocks.
+void init_nets(
+    internal_def &internal,
+    std::size_t num_nets,
+    std::size_t num_threads) {
+  internal.m_d_nets.clear();
+  internal.m_d_nets.reserve(num_nets);
+  internal.m_resources.clear();
+  for (std::size_t thread_idx = 0; thread_idx < num_threads; ++thread_idx) {
+    auto &resource = internal.m_resources.emplace_back(
+        std::make_unique<std::pmr::monotonic_buffer_resource>(
+            SPEF_SLAB_SIZE));
+    for (std::size_t net_idx =
+             thread_first_idx(num_nets, num_threads, thread_idx);
+         net_idx < thread_first_idx(num_nets, num_threads, thread_idx + 1);
+         ++net_idx) {
+      internal.m_d_nets.emplace_back(d_net::allocator_type(resource.get()));
     }
   }
 }
@@ -464,17 +1321,293 @@ std::uniform_real_distribution<double> &get_cap_dist() {
   return dist;
 }
 
-std::string const &
-get_rand_node(conn_sec const &conns, design_config const &config) {
-  auto const &pins = conns.m_conn_def;
-  auto const &nodes = conns.m_internal_node_coord;
-  auto const num_pins = pins.size();
-  auto const num_nodes = num_pins + nodes.size();
+spef_estimate estimate_block_spef(design_config const &config) {
+  SPEF_file spef;
+  gen_header(spef, config.block_name, config);
+  gen_block_ports(spef);
 
-  auto node_idx_dist = get_idx_dist(0, num_nodes - 1);
-  auto node_idx = node_idx_dist(config.gen);
-  if (node_idx < num_pins) {
-    return pins[node_idx].m_name;
+  std::size_t const num_nets = config.num_nets;
+  double const ccaps_added = ccaps_added_per_net(config);
+  double const ccaps_per_net = 2 * ccaps_added;
+  auto const num_ccaps = static_cast<std::size_t>(std::llround(ccaps_per_net));
+  double const mid_val = (config.min_cap_val + config.max_cap_val) / 2;
+  std::size_t const val_len = fmt::formatted_size("{:.1f}", mid_val);
+
+  name_map map;
+  if (config.name_map) {
+    gen_block_name_map(map, config);
+  }
+  std::size_t const cell_len =
+      config.name_map ? ALIAS_PREFIX.size() : config.cell_prefix.size();
+  std::size_t const net_len =
+      config.name_map ? ALIAS_PREFIX.size() : config.net_prefix.size();
+  std::size_t const net_offset =
+      config.name_map ? block_net_alias_offset(config) : 0;
+  // "u<idx>:A" etc., with a one character pin delimiter
+  auto const pin_len = [cell_len](std::size_t idx, std::string const &pin) {
+    return cell_len + num_digits(idx) + 1 + pin.size();
+  };
+
+  // the name map isn't generated here, so that a dry run stays cheap
+  std::size_t fixed_bytes = spef_head_size(spef) + name_map_size(map);
+  std::size_t val_bytes = 0;
+  std::size_t ccap_bytes = 0;
+  double node_len_sum = 0;
+  std::size_t model_bytes = num_nets * sizeof(d_net);
+
+  for (std::size_t net_idx = 0; net_idx < num_nets; ++net_idx) {
+    std::size_t num_ground_caps = 4;
+    std::size_t num_ress = 3;
+    if (net_idx == 0) {
+      num_ground_caps = 2;
+      num_ress = 1;
+      std::size_t const load_len = pin_len(1, config.lib_cell_inp_pin);
+      // "*D_NET A ", "*CONN", "*P A O", "*I u1:A I", "*CAP", "1 A ",
+      // "2 u1:A ", "*RES", "1 A u1:A ", "*END" and their newlines
+      fixed_bytes += 10 + 6 + 7 + (load_len + 6) + 5 + 5 + (load_len + 4) + 5
+                     + (load_len + 6) + 5;
+      node_len_sum += static_cast<double>(1 + load_len) / 2;
+      // the node names are stored once, in the `name_arena`
+      model_bytes += arena_size<conn_def>(2) + 1 + load_len;
+    } else {
+      bool const is_net_to_leaf_cell = net_idx >= num_nets / 2;
+      std::string const &load_pin = is_net_to_leaf_cell
+                                        ? config.lib_leaf_cell_d_pin
+                                        : config.lib_cell_inp_pin;
+      std::size_t const ref_len = net_len + num_digits(net_offset + net_idx);
+      std::size_t const driver_len = pin_len(net_idx, config.lib_cell_out_pin);
+      std::size_t const load1_len = pin_len(net_idx * 2, load_pin);
+      std::size_t const load2_len = pin_len(net_idx * 2 + 1, load_pin);
+      std::size_t const node_len = ref_len + 2;
+      std::size_t const names_len = driver_len + load1_len + load2_len;
+
+      // "*D_NET n<idx> ", "*CONN", the 3 "*I <pin> <dir>",
+      // "*N n<idx>:1 *C 0 0", "*CAP", the 4 "<idx> <node> ", "*RES", the 3
+      // "<idx> <node1> <node2> ", "*END" and their newlines
+      fixed_bytes += (ref_len + 9) + 6 + (names_len + 18) + (node_len + 11) + 5
+                     + (names_len + node_len + 16) + 5
+                     + (names_len + 3 * node_len + 15) + 5;
+      node_len_sum += static_cast<double>(names_len + node_len) / 4;
+      model_bytes += arena_size<conn_def>(3)
+                     + arena_size<internal_node_coord>(1)
+                     + ref_len + names_len + node_len;
+    }
+
+    // the values of the ground capacitances and resistances, and the total
+    double const total_val =
+        static_cast<double>(num_ground_caps + num_ccaps) * mid_val;
+    val_bytes += (num_ground_caps + num_ress) * val_len
+                 + fmt::formatted_size("{:.1f}", total_val);
+    // the indices of the coupling capacitance lines
+    ccap_bytes +=
+        sum_digits(num_ground_caps + 1, num_ground_caps + num_ccaps + 1);
+    model_bytes += arena_size<cap>(num_ground_caps)
+                   + arena_size<res>(num_ress);
+  }
+
+  spef_estimate estimate;
+  estimate.m_ccaps_per_net = ccaps_per_net;
+  estimate.m_num_ccaps = ccaps_added * static_cast<double>(num_nets);
+  double const mean_node_len =
+      num_nets == 0 ? 0 : node_len_sum / static_cast<double>(num_nets);
+  // each coupling capacitance is written in both nets as
+  // "<idx> <node1> <node2> <value>\n"
+  double const ccap_line_bytes =
+      2 * mean_node_len + static_cast<double>(val_len + 4);
+  estimate.m_fixed_bytes = fixed_bytes;
+  estimate.m_expected_bytes =
+      fixed_bytes + val_bytes + ccap_bytes
+      + static_cast<std::size_t>(
+          std::llround(2 * estimate.m_num_ccaps * ccap_line_bytes));
+  // the streaming path only keeps the coupling capacitances in memory
+  estimate.m_model_bytes =
+      (config.stream_spef ? 0 : model_bytes)
+      + coupling_caps_heap_size(
+          num_nets,
+          static_cast<std::size_t>(std::llround(estimate.m_num_ccaps)));
+  return estimate;
+}
+
+spef_estimate estimate_top_spef(design_config const &config) {
+  SPEF_file spef;
+  gen_header(spef, config.top_name, config);
+  gen_top_ports(spef, config);
+
+  std::size_t const num_nets = config.num_blocks;
+  double const ccaps_added = ccaps_added_per_net(config);
+  double const ccaps_per_net = 2 * ccaps_added;
+  auto const num_ccaps = static_cast<std::size_t>(std::llround(ccaps_per_net));
+  double const mid_val = (config.min_cap_val + config.max_cap_val) / 2;
+  std::size_t const val_len = fmt::formatted_size("{:.1f}", mid_val);
+  std::size_t const num_ground_caps = 2;
+  std::size_t const num_ress = 1;
+  name_map map;
+  if (config.name_map) {
+    gen_top_name_map(map, config);
   }
-  return nodes[node_idx - num_pins].m_internal_node.first;
+  std::size_t const block_len =
+      config.name_map ? ALIAS_PREFIX.size() : config.block_prefix.size();
+
+  std::size_t fixed_bytes = spef_head_size(spef) + name_map_size(map);
+  std::size_t val_bytes = 0;
+  std::size_t ccap_bytes = 0;
+  double node_len_sum = 0;
+  std::size_t model_bytes = num_nets * sizeof(d_net);
+
+  for (std::size_t block_idx = 0; block_idx < num_nets; ++block_idx) {
+    // "A<idx>" and "b<idx>/A"
+    std::size_t const port_len = 1 + num_digits(block_idx + 1);
+    std::size_t const pin_len = block_len + num_digits(block_idx + 1) + 2;
+
+    // "*D_NET A<idx> ", "*CONN", "*P A<idx> O", "*I b<idx>/A I", "*CAP",
+    // "1 A<idx> ", "2 b<idx>/A ", "*RES", "1 A<idx> b<idx>/A ", "*END" and
+    // their newlines
+    fixed_bytes += (port_len + 9) + 6 + (port_len + 6) + (pin_len + 6) + 5
+                   + (port_len + 4) + (pin_len + 4) + 5
+                   + (port_len + pin_len + 5) + 5;
+    node_len_sum += static_cast<double>(port_len + pin_len) / 2;
+
+    double const total_val =
+        static_cast<double>(num_ground_caps + num_ccaps) * mid_val;
+    val_bytes += (num_ground_caps + num_ress) * val_len
+                 + fmt::formatted_size("{:.1f}", total_val);
+    ccap_bytes +=
+        sum_digits(num_ground_caps + 1, num_ground_caps + num_ccaps + 1);
+    model_bytes += arena_size<conn_def>(2)
+                   + arena_size<cap>(num_ground_caps)
+                   + arena_size<res>(num_ress)
+                   + 2 * port_len + pin_len;
+  }
+
+  spef_estimate estimate;
+  estimate.m_ccaps_per_net = ccaps_per_net;
+  estimate.m_num_ccaps = ccaps_added * static_cast<double>(num_nets);
+  double const mean_node_len =
+      num_nets == 0 ? 0 : node_len_sum / static_cast<double>(num_nets);
+  double const ccap_line_bytes =
+      2 * mean_node_len + static_cast<double>(val_len + 4);
+  estimate.m_fixed_bytes = fixed_bytes;
+  estimate.m_expected_bytes =
+      fixed_bytes + val_bytes + ccap_bytes
+      + static_cast<std::size_t>(
+          std::llround(2 * estimate.m_num_ccaps * ccap_line_bytes));
+  // the streaming path only keeps the coupling capacitances in memory
+  estimate.m_model_bytes =
+      (config.stream_spef ? 0 : model_bytes)
+      + coupling_caps_heap_size(
+          num_nets,
+          static_cast<std::size_t>(std::llround(estimate.m_num_ccaps)));
+  return estimate;
+}
+
+// the size of everything before the first `*D_NET`
+std::size_t spef_head_size(SPEF_file const &spef) {
+  std::ostringstream os;
+  {
+    output_buffer out(os);
+    spef.write_head(out);
+  }
+  return os.str().size();
+}
+
+// the size of `map` once written, without writing its ranges
+std::size_t name_map_size(name_map const &map) {
+  if (map.m_map.empty() && map.m_ranges.empty()) {
+    return 0;
+  }
+  // "*NAME_MAP\n"
+  std::size_t size = 10;
+  // "*<index> <prefix><suffix>\n"
+  for (name_map::name_range const &range : map.m_ranges) {
+    size += range.m_size * (range.m_prefix.size() + 3)
+            + sum_digits(
+                range.m_first_index,
+                range.m_first_index + range.m_size)
+            + sum_digits(
+                range.m_first_suffix,
+                range.m_first_suffix + range.m_size);
+  }
+  for (auto const &[index, name] : map.m_map) {
+    size += num_digits(index) + name.size() + 3;
+  }
+  return size;
+}
+
+// Returns the expected number of coupling capacitances each net adds in
+// `gen_*_net_cap_sec_coupling`, averaged over all the nets.
+//
+// Each net adds capacitances until it has `min_num_ccaps` of them, but by the
+// time we get to it, it has already received some from the nets before it,
+// each of which picked it with probability 1/num_nets. For many nets, the
+// number of capacitances the net at x * num_nets has received is Poisson
+// distributed with a mean lambda(x), and
+//   lambda'(x) = E[max(0, min_num_ccaps - Poisson(lambda(x)))]
+// The result is lambda(1), which we get with a Runge-Kutta integration.
+//
+// In counter mode, each net first adds min_num_ccaps / 2 capacitances, and
+// receives as many on average, again Poisson distributed, and then adds the
+// ones it misses.
+double ccaps_added_per_net(design_config const &config) {
+  std::size_t const min_num_ccaps = config.min_num_ccaps;
+  if (config.rng == rng_mode::COUNTER) {
+    std::size_t const num_first = min_num_ccaps / 2;
+    return static_cast<double>(num_first)
+           + expected_missing(
+               min_num_ccaps - num_first,
+               static_cast<double>(num_first));
+  }
+
+  auto const added = [min_num_ccaps](double lambda) {
+    return expected_missing(min_num_ccaps, lambda);
+  };
+
+  constexpr std::size_t num_steps{1'000};
+  constexpr double step{1.0 / num_steps};
+  double lambda = 0;
+  for (std::size_t step_idx = 0; step_idx < num_steps; ++step_idx) {
+    double const k1 = added(lambda);
+    double const k2 = added(lambda + step / 2 * k1);
+    double const k3 = added(lambda + step / 2 * k2);
+    double const k4 = added(lambda + step * k3);
+    lambda += step / 6 * (k1 + 2 * k2 + 2 * k3 + k4);
+  }
+  return lambda;
+}
+
+// E[max(0, num_ccaps - Poisson(lambda))]
+double expected_missing(std::size_t num_ccaps, double lambda) {
+  double expected = 0;
+  double poisson = std::exp(-lambda);
+  for (std::size_t num_caps = 0; num_caps < num_ccaps; ++num_caps) {
+    expected += static_cast<double>(num_ccaps - num_caps) * poisson;
+    poisson *= lambda / static_cast<double>(num_caps + 1);
+  }
+  return expected;
+}
+
+// the memory glibc malloc takes for an allocation of `size` bytes
+std::size_t heap_size(std::size_t size) {
+  return std::max<std::size_t>(32, (size + 8 + 15) & ~std::size_t{15});
+}
+
+// the heap memory of an `std::vector<T>` filled with `emplace_back`
+template <typename T>
+std::size_t vector_heap_size(std::size_t num_elems) {
+  return num_elems == 0 ? 0 : heap_size(std::bit_ceil(num_elems) * sizeof(T));
+}
+
+// the memory of an `std::pmr::vector<T>` reserved upfront in a
+// `monotonic_buffer_resource`
+template <typename T>
+std::size_t arena_size(std::size_t num_elems) {
+  return num_elems * sizeof(T);
+}
+
+// the heap memory of the `coupling_caps` of a file
+std::size_t coupling_caps_heap_size(
+    std::size_t num_nets,
+    std::size_t num_ccaps) {
+  return vector_heap_size<coupling_caps::coupling_cap>(num_ccaps)
+         + heap_size((num_nets + 1) * sizeof(std::size_t))
+         + heap_size(2 * num_ccaps * sizeof(std::uint32_t));
 }
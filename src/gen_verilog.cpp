@@ -1,112 +1,274 @@
-#ifdef WRITE_COMPRESSED
-#include <boost/iostreams/device/file.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
-#include <boost/iostreams/filtering_streambuf.hpp>
-#include <ostream>
-#else
-#include <fstream>
-#endif
-
 #include <fmt/format.h>
-#include <fmt/ostream.h>
+#include <optional>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "checkpoint.hpp"
 #include "design_config.hpp"
+#include "gen_verilog.hpp"
+#include "mapped_file.hpp"
+#include "num_digits.hpp"
+#include "output_buffer.hpp"
+#include "output_sink.hpp"
+#include "verilog_cells.hpp"
+#include "wrapped_writer.hpp"
 
 // forward declarations
-template <typename OSTREAM>
-void write_wires(OSTREAM &os, design_config const &config);
-template <typename OSTREAM>
-void write_cells(OSTREAM &os, design_config const &config);
-template <typename OSTREAM>
-void write_wrapped(
-    OSTREAM &os,
-    std::string const &str,
-    std::size_t first_indent,
-    std::size_t rest_indent,
-    std::size_t column);
-template <typename OSTREAM>
-void write_wrapped_too_long_indent(
-    OSTREAM &os,
-    std::string const &str,
-    std::size_t first_indent,
-    std::size_t rest_indent);
-
-void write_block_verilog(design_config const &config) {
-#ifdef WRITE_COMPRESSED
-  std::string filename{config.block_name + ".v.gz"};
-  boost::iostreams::filtering_ostreambuf buf;
-  buf.push(boost::iostreams::gzip_compressor());
-  buf.push(boost::iostreams::file_sink(filename));
-  std::ostream os(&buf);
-#else
-  std::string filename{config.block_name + ".v"};
-  std::ofstream os(filename);
-#endif
-  fmt::println(os, "module {}(A);", config.block_name);
-  fmt::println(os, "  input A;");
-  write_wires(os, config);
-  write_cells(os, config);
-  fmt::println(os, "endmodule");
+std::string block_module_lines(design_config const &config);
+std::string block_first_cell_line(design_config const &config);
+void write_block_verilog_parallel(
+    std::string const &path,
+    design_config const &config,
+    file_progress &progress,
+    checkpointer &checkpoints,
+    run_stats &stats);
+std::size_t wires_size(design_config const &config);
+std::size_t cells_size(
+    design_config const &config,
+    cell_line_parts const &parts,
+    std::size_t first_idx,
+    std::size_t last_idx);
+
+// the number of cells written between two looks at whether a checkpoint is
+// due
+static constexpr std::size_t CHECKPOINT_CELLS{1024};
+
+void write_block_verilog(
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats) {
+  phase_timer const total(stats, progress.m_name, "total");
+  std::string const path =
+      output_path(config.block_verilog_path, config.block_name + ".v", config);
+  checkpointer checkpoints(path, config);
+  std::optional<checkpoint> const &resumed = checkpoints.resumed();
+  if (resumed && resumed->m_done) {
+    progress.m_bytes_written = resumed->m_offset;
+    progress.m_done = true;
+    return;
+  }
+  // the parallel writer places the lines at their offsets in the file, which
+  // a compressed file or a pipe doesn't have. It is written again as a whole
+  // unless it is done.
+  if (config.num_threads > 1 && config.codec == output_codec::NONE
+      && seekable_output(path)) {
+    write_block_verilog_parallel(path, config, progress, checkpoints, stats);
+    progress.m_done = true;
+    return;
+  }
+  // the checkpoints are between the cells, after the wires
+  std::size_t first_idx = 0;
+  std::uint64_t resume_offset = 0;
+  if (resumed) {
+    first_idx = resumed->m_next_idx;
+    resume_offset = resumed->m_offset;
+  }
+  auto const sink = open_output_sink(
+      path,
+      config,
+      resume_offset,
+      &progress.m_compressed_bytes);
+  progress.m_bytes_written = resume_offset;
+  output_buffer out(*sink);
+  out.count_bytes(progress.m_bytes_written);
+  if (!resumed) {
+    out.append(block_module_lines(config));
+    write_wires(out, config);
+    out.append(block_first_cell_line(config));
+  }
+  cell_line_parts const parts(config);
+  std::size_t const num_cells = 2 * config.num_nets;
+  for (std::size_t idx = first_idx; idx < num_cells; idx += CHECKPOINT_CELLS) {
+    std::size_t const last_idx = std::min(idx + CHECKPOINT_CELLS, num_cells);
+    write_cells(out, config, parts, idx, last_idx);
+    checkpoints.save_if_due(last_idx, out, *sink);
+  }
+  out.append("endmodule\n");
+  checkpoints.finish(out, *sink);
+  out.flush();
+  sink->close();
+  progress.m_done = true;
+}
+
+// Every line of the cells depends only on its index, so we can compute upfront
+// where each line goes in the file. We split the cells in contiguous ranges,
+// and each thread formats its range directly at its place in the file, while
+// the current thread writes the module header and the wires. The result is
+// byte-identical to `write_block_verilog`.
+void write_block_verilog_parallel(
+    std::string const &path,
+    design_config const &config,
+    file_progress &progress,
+    checkpointer &checkpoints,
+    run_stats &stats) {
+  cell_line_parts const parts(config);
+  std::string const module_lines = block_module_lines(config);
+  std::string const first_cell_line = block_first_cell_line(config);
+  std::string_view const endmodule_line = "endmodule\n";
+
+  std::size_t const num_cells = 2 * config.num_nets;
+  std::size_t const head_size =
+      module_lines.size() + wires_size(config) + first_cell_line.size();
+
+  unlink_shared_file(path);
+  mapped_file file(path, block_verilog_size(config));
+  std::span<char> const data = file.data();
+  {
+    std::vector<std::jthread> workers;
+    std::size_t offset = head_size;
+    for (std::size_t thread_idx = 0; thread_idx < config.num_threads;
+         ++thread_idx) {
+      std::size_t const first_idx = num_cells * thread_idx / config.num_threads;
+      std::size_t const last_idx =
+          num_cells * (thread_idx + 1) / config.num_threads;
+      std::size_t const size = cells_size(config, parts, first_idx, last_idx);
+      workers.emplace_back(
+          [&config, &parts, &progress, &stats, thread_idx, first_idx, last_idx](
+              std::span<char> span) {
+            // the phases of the workers, next to the "total" of the file
+            phase_timer const worker(
+                stats,
+                progress.m_name,
+                fmt::format("cells/worker{}", thread_idx));
+            span_sink sink(span);
+            {
+              output_buffer out(sink);
+              out.count_bytes(progress.m_bytes_written);
+              write_cells(out, config, parts, first_idx, last_idx);
+            }
+            ASSERT(sink.full(), "cells size mismatch", first_idx, last_idx);
+          },
+          data.subspan(offset, size));
+      offset += size;
+    }
+
+    span_sink sink(data.first(head_size));
+    {
+      output_buffer out(sink);
+      out.count_bytes(progress.m_bytes_written);
+      out.append(module_lines);
+      write_wires(out, config);
+      out.append(first_cell_line);
+    }
+    ASSERT(sink.full(), "module header size mismatch");
+  }
+  std::ranges::copy(endmodule_line, data.last(endmodule_line.size()).begin());
+  progress.m_bytes_written += endmodule_line.size();
+  if (checkpoints.enabled()) {
+    file.sync();
+    checkpoints.finish(data.size());
+  }
+}
+
+std::size_t block_verilog_size(design_config const &config) {
+  return block_module_lines(config).size() + wires_size(config)
+         + block_first_cell_line(config).size()
+         + cells_size(config, cell_line_parts(config), 0, 2 * config.num_nets)
+         + std::string_view{"endmodule\n"}.size();
+}
+
+std::size_t top_verilog_size(design_config const &config) {
+  std::size_t const last_block_idx =
+      std::max<std::size_t>(config.num_blocks, 1);
+
+  std::size_t size = 0;
+  {
+    // "module top(A1, A2, ..., A<num_blocks>);"
+    wrapped_size module_line(0, 2, config.num_cols);
+    module_line.add_word(std::string_view{"module"}.size());
+    for (std::size_t block_idx = 1; block_idx < last_block_idx; ++block_idx) {
+      // "A<block_idx>,"
+      module_line.add_word(
+          (block_idx == 1 ? config.top_name.size() + 1 : 0) + 1
+          + num_digits(block_idx) + 1);
+    }
+    // "A<last_block_idx>);"
+    size += module_line.finish(
+        (last_block_idx == 1 ? config.top_name.size() + 1 : 0) + 1
+        + num_digits(last_block_idx) + 2);
+  }
+  {
+    // "input A1, A2, ..., A<num_blocks>;"
+    wrapped_size input_line(2, 2, config.num_cols);
+    input_line.add_word(std::string_view{"input"}.size());
+    for (std::size_t block_idx = 1; block_idx < last_block_idx; ++block_idx) {
+      input_line.add_word(1 + num_digits(block_idx) + 1);
+    }
+    size += input_line.finish(1 + num_digits(last_block_idx) + 1);
+  }
+
+  // "  block b<block_idx>(.A(A<block_idx>));"
+  size += config.num_blocks
+          * (2 + config.block_name.size() + 1 + config.block_prefix.size()
+             + std::string_view{"(.A(A"}.size()
+             + std::string_view{"));\n"}.size());
+  size += 2 * sum_digits(1, config.num_blocks + 1);
+
+  return size + std::string_view{"endmodule\n"}.size();
 }
 
-void write_top_verilog(design_config const &config) {
-#ifdef WRITE_COMPRESSED
-  std::string filename{config.top_name + ".v.gz"};
-  boost::iostreams::filtering_ostreambuf buf;
-  buf.push(boost::iostreams::gzip_compressor());
-  buf.push(boost::iostreams::file_sink(filename));
-  std::ostream os(&buf);
-#else
-  std::string filename{config.top_name + ".v"};
-  std::ofstream os(filename);
-#endif
+void write_top_verilog(
+    design_config const &config,
+    file_progress &progress,
+    run_stats &stats) {
+  phase_timer const total(stats, progress.m_name, "total");
+  std::string const path =
+      output_path(config.top_verilog_path, config.top_name + ".v", config);
+  // it is small enough to be written again, unless it is done
+  checkpointer checkpoints(path, config);
+  if (checkpoints.resumed() && checkpoints.resumed()->m_done) {
+    progress.m_bytes_written = checkpoints.resumed()->m_offset;
+    progress.m_done = true;
+    return;
+  }
+  auto const sink =
+      open_output_sink(path, config, 0, &progress.m_compressed_bytes);
+  output_buffer out(*sink);
+  out.count_bytes(progress.m_bytes_written);
   {
-    std::string module_line = fmt::format("module {}(A1", config.top_name);
+    wrapped_writer module_line(out, 0, 2, config.num_cols);
+    module_line.print("module {}(A1", config.top_name);
     for (std::size_t block_idx = 2; block_idx <= config.num_blocks; ++block_idx) {
-      module_line += fmt::format(", A{}", block_idx);
+      module_line.print(", A{}", block_idx);
     }
-    module_line += ");";
-    write_wrapped(os, module_line, 0, 2, config.num_cols);
+    module_line.append(");");
+    module_line.finish();
   }
 
   {
-    std::string input_line = fmt::format("input A1");
+    wrapped_writer input_line(out, 2, 2, config.num_cols);
+    input_line.append("input A1");
     for (std::size_t block_idx = 2; block_idx <= config.num_blocks; ++block_idx) {
-      input_line += fmt::format(", A{}", block_idx);
+      input_line.print(", A{}", block_idx);
     }
-    input_line += ";";
-    write_wrapped(os, input_line, 2, 2, config.num_cols);
+    input_line.append(";");
+    input_line.finish();
   }
 
   for (std::size_t block_idx = 0; block_idx < config.num_blocks; ++block_idx) {
-    fmt::println(
-        os,
+    out.println(
         "  {} {}{}(.A(A{}));",
         config.block_name,
         config.block_prefix,
         block_idx + 1,
         block_idx + 1);
   }
-  fmt::println(os, "endmodule");
+  out.println("endmodule");
+  checkpoints.finish(out, *sink);
+  out.flush();
+  sink->close();
+  progress.m_done = true;
 }
 
-template <typename OSTREAM>
-void write_wires(OSTREAM &os, design_config const &config) {
-  std::string wire_line = fmt::format("wire {}1", config.net_prefix);
-  for (std::size_t net_idx = 2; net_idx < config.num_nets; ++net_idx) {
-    wire_line += fmt::format(", {}{}", config.net_prefix, net_idx);
-  }
-  wire_line += ";";
-  write_wrapped(os, wire_line, 2, 2, config.num_cols);
+std::string block_module_lines(design_config const &config) {
+  return fmt::format("module {}(A);\n  input A;\n", config.block_name);
 }
 
-template <typename OSTREAM>
-void write_cells(OSTREAM &os, design_config const &config) {
-  // the first cell is a special case, since it connects to the input port
-  fmt::println(
-      os,
-      "  {} {}{}(.{}(A), .{}({}{}));",
+// the first cell is a special case, since it connects to the input port
+std::string block_first_cell_line(design_config const &config) {
+  return fmt::format(
+      "  {} {}{}(.{}(A), .{}({}{}));\n",
       config.lib_cell_name,
       config.cell_prefix,
       1,
@@ -114,101 +276,50 @@ void write_cells(OSTREAM &os, design_config const &config) {
       config.lib_cell_out_pin,
       config.net_prefix,
       1);
-  for (std::size_t net_idx = 2; net_idx < config.num_nets; ++net_idx) {
-    fmt::println(
-        os,
-        "  {} {}{}(.{}({}{}), .{}({}{}));",
-        config.lib_cell_name,
-        config.cell_prefix,
-        net_idx,
-        config.lib_cell_inp_pin,
-        config.net_prefix,
-        net_idx / 2,
-        config.lib_cell_out_pin,
-        config.net_prefix,
-        net_idx);
-  }
-  // leaf cells
-  for (std::size_t net_idx = config.num_nets; net_idx < 2 * config.num_nets; ++net_idx) {
-    fmt::println(
-        os,
-        "  {} {}{}(.{}({}{}));",
-        config.lib_leaf_cell_name,
-        config.cell_prefix,
-        net_idx,
-        config.lib_leaf_cell_d_pin,
-        config.net_prefix,
-        net_idx / 2);
-  }
 }
 
-template <typename OSTREAM>
-void write_wrapped(
-    OSTREAM &os,
-    std::string const &str,
-    std::size_t first_indent,
-    std::size_t rest_indent,
-    std::size_t column) {
-  std::string first_indent_str(first_indent, ' ');
-  std::string rest_indent_str(rest_indent, ' ');
-
-  if (first_indent >= column || rest_indent >= column) {
-    write_wrapped_too_long_indent(os, str, first_indent, rest_indent);
-    return;
+// the size of what `write_wires` writes, computed from the lengths of the
+// net names alone
+std::size_t wires_size(design_config const &config) {
+  wrapped_size size(2, 2, config.num_cols);
+  size.add_word(std::string_view{"wire"}.size());
+  std::size_t const last_net_idx =
+      std::max<std::size_t>(config.num_nets, 2) - 1;
+  for (std::size_t net_idx = 1; net_idx < last_net_idx; ++net_idx) {
+    // "n<net_idx>,"
+    size.add_word(config.net_prefix.size() + num_digits(net_idx) + 1);
   }
-
-  std::size_t left = 0;
-  while (left < str.size()) {
-    std::size_t right =
-        left + column - (left == 0 ? first_indent : rest_indent);
-    if (right >= str.size()) {
-      break;
-    }
-    while (right > left && str[right] != ' ') {
-      --right;
-    }
-    if (right == left) {
-      while (right < str.size() && str[right] != ' ') {
-        ++right;
-      }
-    }
-    if (right >= str.size()) {
-      break;
-    }
-    fmt::println(
-        os,
-        "{}{}",
-        left == 0 ? first_indent_str : rest_indent_str,
-        str.substr(left, right - left));
-    left = right + 1;
-  }
-  fmt::println(
-      os,
-      "{}{}",
-      left == 0 ? first_indent_str : rest_indent_str,
-      str.substr(left, str.size() - left));
+  // "n<last_net_idx>;"
+  return size.finish(config.net_prefix.size() + num_digits(last_net_idx) + 1);
 }
 
-template <typename OSTREAM>
-void write_wrapped_too_long_indent(
-    OSTREAM &os,
-    std::string const &str,
-    std::size_t first_indent,
-    std::size_t rest_indent) {
-  std::string first_indent_str(first_indent, ' ');
-  std::string rest_indent_str(rest_indent, ' ');
-
-  std::size_t left = 0;
-  while (left < str.size()) {
-    std::size_t right = left;
-    while (right < str.size() && str[right] != ' ') {
-      ++right;
-    }
-    fmt::println(
-        os,
-        "{}{}",
-        left == 0 ? first_indent_str : rest_indent_str,
-        str.substr(left, right - left));
-    left = right + 1;
+// the size of what `write_cells` writes for the same range of indices
+std::size_t cells_size(
+    design_config const &config,
+    cell_line_parts const &parts,
+    std::size_t first_idx,
+    std::size_t last_idx) {
+  std::size_t size = 0;
+
+  std::size_t const first_cell_idx = std::max<std::size_t>(first_idx, 2);
+  std::size_t const last_cell_idx = std::min(last_idx, config.num_nets);
+  if (first_cell_idx < last_cell_idx) {
+    size += (last_cell_idx - first_cell_idx)
+            * (parts.m_cell_head.size() + parts.m_cell_inp.size()
+               + parts.m_cell_out.size() + parts.m_tail.size());
+    size += 2 * sum_digits(first_cell_idx, last_cell_idx, 1);
+    size += sum_digits(first_cell_idx, last_cell_idx, 2);
   }
+
+  std::size_t const first_leaf_idx = std::max(first_idx, config.num_nets);
+  std::size_t const last_leaf_idx = std::min(last_idx, 2 * config.num_nets);
+  if (first_leaf_idx < last_leaf_idx) {
+    size += (last_leaf_idx - first_leaf_idx)
+            * (parts.m_leaf_head.size() + parts.m_leaf_inp.size()
+               + parts.m_tail.size());
+    size += sum_digits(first_leaf_idx, last_leaf_idx, 1);
+    size += sum_digits(first_leaf_idx, last_leaf_idx, 2);
+  }
+
+  return size;
 }
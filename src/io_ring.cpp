@@ -0,0 +1,191 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <libassert/assert.hpp>
+#include <string>
+#include <system_error>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "io_ring.hpp"
+
+namespace {
+[[noreturn]] void throw_errno(std::string const &what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+} // namespace
+
+#ifdef HAVE_IO_URING
+
+namespace {
+// maps a part of the ring of `fd`
+void *map_ring(int fd, std::size_t size, off_t offset) {
+  void *addr = ::mmap(
+      nullptr,
+      size,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE,
+      fd,
+      offset);
+  if (addr == MAP_FAILED) {
+    throw_errno("mmap io_uring");
+  }
+  return addr;
+}
+
+template <typename T>
+T *ring_field(void *ring, std::uint32_t offset) {
+  return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+}
+} // namespace
+
+io_ring::io_ring(unsigned num_entries) {
+  io_uring_params params{};
+  m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, num_entries, &params));
+  if (m_fd < 0) {
+    throw_errno("io_uring_setup");
+  }
+  // IORING_OP_WRITE came with Linux 5.6, as did this feature, while the
+  // kernels since 5.1 set up the ring, and then fail every write with EINVAL
+  if ((params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+    release();
+    errno = ENOSYS;
+    throw_errno("io_uring without IORING_OP_WRITE");
+  }
+
+  // the rings are mapped separately, which every kernel supports, even those
+  // that could map them at once (IORING_FEAT_SINGLE_MMAP)
+  try {
+    m_sq_ring_size =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_sq_ring = map_ring(m_fd, m_sq_ring_size, IORING_OFF_SQ_RING);
+    m_cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_cq_ring = map_ring(m_fd, m_cq_ring_size, IORING_OFF_CQ_RING);
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = map_ring(m_fd, m_sqes_size, IORING_OFF_SQES);
+  } catch (...) {
+    release();
+    throw;
+  }
+
+  m_sq_tail = ring_field<unsigned>(m_sq_ring, params.sq_off.tail);
+  m_sq_mask = *ring_field<unsigned>(m_sq_ring, params.sq_off.ring_mask);
+  m_sq_array = ring_field<unsigned>(m_sq_ring, params.sq_off.array);
+  m_cq_head = ring_field<unsigned>(m_cq_ring, params.cq_off.head);
+  m_cq_tail = ring_field<unsigned>(m_cq_ring, params.cq_off.tail);
+  m_cq_mask = *ring_field<unsigned>(m_cq_ring, params.cq_off.ring_mask);
+  m_cqes = ring_field<io_uring_cqe>(m_cq_ring, params.cq_off.cqes);
+}
+
+io_ring::~io_ring() {
+  release();
+}
+
+void io_ring::release() {
+  if (m_sqes != nullptr) {
+    ::munmap(m_sqes, m_sqes_size);
+  }
+  if (m_cq_ring != nullptr) {
+    ::munmap(m_cq_ring, m_cq_ring_size);
+  }
+  if (m_sq_ring != nullptr) {
+    ::munmap(m_sq_ring, m_sq_ring_size);
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+}
+
+void io_ring::write(
+    int fd,
+    char const *data,
+    std::size_t size,
+    std::uint64_t offset,
+    std::uint64_t user_data) {
+  // only this thread moves the tail, the kernel moves the head
+  unsigned const tail = *m_sq_tail;
+  unsigned const idx = tail & m_sq_mask;
+  io_uring_sqe &sqe = static_cast<io_uring_sqe *>(m_sqes)[idx];
+  std::memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_WRITE;
+  sqe.fd = fd;
+  sqe.addr = reinterpret_cast<std::uintptr_t>(data);
+  sqe.len = static_cast<std::uint32_t>(size);
+  sqe.off = offset;
+  sqe.user_data = user_data;
+  m_sq_array[idx] = idx;
+  std::atomic_ref(*m_sq_tail).store(tail + 1, std::memory_order_release);
+  enter(1, 0, 0);
+}
+
+io_ring::completion io_ring::wait() {
+  while (true) {
+    // only this thread moves the head, the kernel moves the tail
+    unsigned const head = *m_cq_head;
+    if (head != std::atomic_ref(*m_cq_tail).load(std::memory_order_acquire)) {
+      io_uring_cqe const &cqe =
+          static_cast<io_uring_cqe const *>(m_cqes)[head & m_cq_mask];
+      completion const done{cqe.user_data, cqe.res};
+      std::atomic_ref(*m_cq_head).store(head + 1, std::memory_order_release);
+      return done;
+    }
+    enter(0, 1, IORING_ENTER_GETEVENTS);
+  }
+}
+
+void io_ring::enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+  while (::syscall(
+             __NR_io_uring_enter,
+             m_fd,
+             to_submit,
+             min_complete,
+             flags,
+             nullptr,
+             0)
+         < 0) {
+    if (errno != EINTR) {
+      throw_errno("io_uring_enter");
+    }
+  }
+}
+
+#else
+
+// built without <linux/io_uring.h>, so io_uring is never available
+
+io_ring::io_ring(unsigned /*num_entries*/) {
+  errno = ENOSYS;
+  throw_errno("io_uring_setup");
+}
+
+io_ring::~io_ring() = default;
+
+void io_ring::write(
+    int /*fd*/,
+    char const * /*data*/,
+    std::size_t /*size*/,
+    std::uint64_t /*offset*/,
+    std::uint64_t /*user_data*/) {
+  UNREACHABLE();
+}
+
+io_ring::completion io_ring::wait() {
+  UNREACHABLE();
+}
+
+void io_ring::enter(
+    unsigned /*to_submit*/,
+    unsigned /*min_complete*/,
+    unsigned /*flags*/) {
+  UNREACHABLE();
+}
+
+void io_ring::release() {}
+
+#endif // HAVE_IO_URING
@@ -0,0 +1,63 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+
+namespace {
+[[noreturn]] void throw_errno(std::string const &what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+} // namespace
+
+mapped_file::mapped_file(std::string const &filename, std::size_t size)
+    : m_size(size) {
+  m_fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (m_fd < 0) {
+    throw_errno("open " + filename);
+  }
+  if (m_size == 0) {
+    return;
+  }
+
+  // reserve the blocks upfront, so that running out of disk space is an error
+  // here, instead of a SIGBUS while writing to the mapping
+  int const err = ::posix_fallocate(m_fd, 0, static_cast<off_t>(m_size));
+  if (err != 0) {
+    errno = err;
+    // e.g. EOPNOTSUPP on file systems without fallocate support
+    if (err != EOPNOTSUPP && err != EINVAL) {
+      ::close(m_fd);
+      throw_errno("fallocate " + filename);
+    }
+    if (::ftruncate(m_fd, static_cast<off_t>(m_size)) != 0) {
+      ::close(m_fd);
+      throw_errno("ftruncate " + filename);
+    }
+  }
+
+  void *addr =
+      ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (addr == MAP_FAILED) {
+    ::close(m_fd);
+    throw_errno("mmap " + filename);
+  }
+  m_data = static_cast<char *>(addr);
+}
+
+mapped_file::~mapped_file() {
+  if (m_data != nullptr) {
+    ::munmap(m_data, m_size);
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+}
+
+void mapped_file::sync() const {
+  if (m_data != nullptr && ::msync(m_data, m_size, MS_SYNC) != 0) {
+    throw_errno("msync");
+  }
+}
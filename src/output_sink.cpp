@@ -0,0 +1,815 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <libassert/assert.hpp>
+#include <mutex>
+#include <optional>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#include <zstd.h>
+
+// makes the input of zlib const
+#define ZLIB_CONST
+#include <zlib.h>
+
+#include "io_ring.hpp"
+#include "output_sink.hpp"
+
+namespace {
+[[noreturn]] void throw_errno(std::string const &what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+// opens `filename` for writing, or duplicates stdout for "-", so that closing
+// it doesn't close stdout. With `resume_offset`, the file is kept, truncated
+// to `resume_offset` bytes, and written from there, and it is also opened for
+// reading, for the part of a block that `async_file_sink` rewrites.
+int open_fd(
+    std::string const &filename,
+    int flags,
+    std::uint64_t resume_offset) {
+  if (resume_offset == 0 && filename != "-") {
+    unlink_shared_file(filename);
+  }
+  int const fd =
+      filename == "-"
+          ? ::dup(STDOUT_FILENO)
+          : ::open(
+                filename.c_str(),
+                (resume_offset != 0 ? O_RDWR : O_WRONLY | O_TRUNC) | O_CREAT
+                    | flags,
+                0644);
+  if (fd < 0) {
+    if (!(errno == EINVAL && (flags & O_DIRECT) != 0)) {
+      throw_errno("open " + filename);
+    }
+    return fd;
+  }
+  if (resume_offset != 0) {
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw_errno("stat " + filename);
+    }
+    // truncating would extend it with zeros
+    if (static_cast<std::uint64_t>(st.st_size) < resume_offset) {
+      ::close(fd);
+      throw std::system_error(
+          std::make_error_code(std::errc::invalid_argument),
+          fmt::format(
+              "{} is shorter than the {} bytes it resumes from",
+              filename,
+              resume_offset));
+    }
+    auto const offset = static_cast<off_t>(resume_offset);
+    if (::ftruncate(fd, offset) != 0 || ::lseek(fd, offset, SEEK_SET) < 0) {
+      ::close(fd);
+      throw_errno("truncate " + filename);
+    }
+  }
+  return fd;
+}
+
+// waits until the data written to `fd` is on the disk
+void sync_fd(int fd, std::string const &filename) {
+  while (::fdatasync(fd) != 0) {
+    if (errno != EINTR) {
+      throw_errno("fdatasync " + filename);
+    }
+  }
+}
+
+// the size of the buffers of the compressed data
+constexpr std::size_t COMPRESSED_BUF_SIZE{std::size_t{1} << 18};
+
+// writes to the file as it is, in order, so that it may be a pipe
+class file_sink : public output_sink {
+public:
+  file_sink(std::string filename, std::uint64_t resume_offset)
+      : m_filename(std::move(filename)),
+        m_fd(open_fd(m_filename, 0, resume_offset)),
+        m_size(resume_offset) {}
+
+  ~file_sink() override {
+    if (m_fd >= 0) {
+      ::close(m_fd);
+    }
+  }
+
+  void write(char const *data, std::streamsize size) override {
+    auto remaining = static_cast<std::size_t>(size);
+    while (remaining != 0) {
+      ssize_t const written = ::write(m_fd, data, remaining);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw_errno("write " + m_filename);
+      }
+      data += written;
+      remaining -= static_cast<std::size_t>(written);
+      m_size += static_cast<std::uint64_t>(written);
+    }
+  }
+
+  void close() override {
+    int const fd = std::exchange(m_fd, -1);
+    if (::close(fd) != 0) {
+      throw_errno("close " + m_filename);
+    }
+  }
+
+  std::uint64_t sync() override {
+    sync_fd(m_fd, m_filename);
+    return m_size;
+  }
+
+private:
+  std::string m_filename;
+  int m_fd{-1};
+  std::uint64_t m_size{};
+};
+
+// Writes to the file asynchronously, so that the formatting thread doesn't
+// wait for the disk: the data is copied into one of `NUM_BUFFERS` aligned
+// buffers, and each full buffer is written at its offset by io_uring, or, where
+// io_uring isn't available, by a thread of `pwrite` calls, while the next ones
+// are filled. With `direct`, the file is opened with O_DIRECT, which bypasses
+// the page cache, and the buffers, their sizes and their offsets are all
+// aligned as it requires.
+class async_file_sink : public output_sink {
+public:
+  static constexpr std::size_t BUFFER_SIZE{std::size_t{1} << 20};
+  static constexpr std::size_t NUM_BUFFERS{4};
+  // the alignment of O_DIRECT, a multiple of the logical block size of the
+  // devices
+  static constexpr std::size_t ALIGNMENT{4096};
+
+  async_file_sink(
+      std::string filename,
+      bool direct,
+      std::uint64_t resume_offset)
+      : m_filename(std::move(filename)),
+        m_data(static_cast<char *>(
+            std::aligned_alloc(ALIGNMENT, NUM_BUFFERS * BUFFER_SIZE))) {
+    if (m_data == nullptr) {
+      throw std::bad_alloc();
+    }
+    // e.g. tmpfs doesn't support O_DIRECT
+    if (direct) {
+      m_fd = open_fd(m_filename, O_DIRECT, resume_offset);
+    }
+    if (m_fd < 0) {
+      m_fd = open_fd(m_filename, 0, resume_offset);
+    }
+    // the buffers stay aligned in the file, so the first one starts with the
+    // end of the last block that is kept
+    if (resume_offset != 0) {
+      m_offset = resume_offset / ALIGNMENT * ALIGNMENT;
+      m_fill = resume_offset - m_offset;
+      ssize_t const read = ::pread(
+          m_fd,
+          buffer(m_current),
+          ALIGNMENT,
+          static_cast<off_t>(m_offset));
+      if (read < 0) {
+        throw_errno("read " + m_filename);
+      }
+      ASSERT(static_cast<std::size_t>(read) == m_fill, "short read", read);
+    }
+
+    // pipes have no offsets, and their buffers are written one after the
+    // other by the thread
+    struct stat st{};
+    if (::fstat(m_fd, &st) != 0) {
+      throw_errno("stat " + m_filename);
+    }
+    m_seekable = S_ISREG(st.st_mode) || S_ISBLK(st.st_mode);
+    if (m_seekable) {
+      try {
+        m_ring.emplace(static_cast<unsigned>(NUM_BUFFERS));
+      } catch (std::system_error const &) {
+      }
+    }
+    if (!m_ring) {
+      m_writer = std::jthread(
+          [this](std::stop_token const &stop) { write_buffers(stop); });
+    }
+  }
+
+  ~async_file_sink() override {
+    // the writes in flight still read the buffers, and their errors can't be
+    // reported anymore
+    while (m_num_in_flight != 0) {
+      try {
+        wait_one();
+      } catch (std::system_error const &) {
+      }
+    }
+    if (m_fd >= 0) {
+      ::close(m_fd);
+    }
+  }
+
+  void write(char const *data, std::streamsize size) override {
+    auto remaining = static_cast<std::size_t>(size);
+    while (remaining != 0) {
+      std::size_t const chunk = std::min(remaining, BUFFER_SIZE - m_fill);
+      std::memcpy(buffer(m_current) + m_fill, data, chunk);
+      m_fill += chunk;
+      data += chunk;
+      remaining -= chunk;
+      if (m_fill == BUFFER_SIZE) {
+        submit_current();
+      }
+    }
+  }
+
+  void close() override {
+    while (m_num_in_flight != 0) {
+      wait_one();
+    }
+    write_current();
+    int const fd = std::exchange(m_fd, -1);
+    if (::close(fd) != 0) {
+      throw_errno("close " + m_filename);
+    }
+  }
+
+  // The current buffer is written as far as it is filled, and stays in
+  // memory, to be written again, whole, once it is full.
+  std::uint64_t sync() override {
+    while (m_num_in_flight != 0) {
+      wait_one();
+    }
+    write_current();
+    sync_fd(m_fd, m_filename);
+    return m_offset + m_fill;
+  }
+
+private:
+  class free_data {
+  public:
+    void operator()(char *data) const {
+      std::free(data);
+    }
+  };
+
+  std::string m_filename;
+  int m_fd{-1};
+  // whether the file has offsets, unlike a pipe
+  bool m_seekable{};
+  std::unique_ptr<char, free_data> m_data;
+  // the buffer being filled, how much of it is, and its offset in the file
+  std::size_t m_current{};
+  std::size_t m_fill{};
+  std::uint64_t m_offset{};
+  // the offsets of the buffers being written
+  std::array<std::uint64_t, NUM_BUFFERS> m_offsets{};
+  std::array<bool, NUM_BUFFERS> m_in_flight{};
+  std::size_t m_num_in_flight{};
+
+  std::optional<io_ring> m_ring;
+
+  // without io_uring, the buffers are written by `m_writer`
+  std::mutex m_mutex;
+  std::condition_variable_any m_cv;
+  // the buffers to write, in order
+  std::deque<std::size_t> m_queue;
+  std::deque<io_ring::completion> m_done;
+  std::jthread m_writer;
+
+  char *buffer(std::size_t idx) const {
+    return m_data.get() + idx * BUFFER_SIZE;
+  }
+
+  // submits the current buffer, and moves on to the next one, once its
+  // previous write is done
+  void submit_current() {
+    m_offsets[m_current] = m_offset;
+    if (m_ring) {
+      m_ring->write(m_fd, buffer(m_current), BUFFER_SIZE, m_offset, m_current);
+    } else {
+      std::lock_guard const lock(m_mutex);
+      m_queue.push_back(m_current);
+      m_cv.notify_all();
+    }
+    // only once it is submitted, so that the destructor doesn't wait for it
+    // otherwise
+    m_in_flight[m_current] = true;
+    ++m_num_in_flight;
+    m_offset += BUFFER_SIZE;
+    m_current = (m_current + 1) % NUM_BUFFERS;
+    m_fill = 0;
+    while (m_in_flight[m_current]) {
+      wait_one();
+    }
+  }
+
+  // waits for a write to complete, and finishes it if it was short
+  void wait_one() {
+    io_ring::completion done;
+    if (m_ring) {
+      done = m_ring->wait();
+    } else {
+      std::unique_lock lock(m_mutex);
+      m_cv.wait(lock, [this] { return !m_done.empty(); });
+      done = m_done.front();
+      m_done.pop_front();
+    }
+    std::size_t const idx = done.m_user_data;
+    m_in_flight[idx] = false;
+    --m_num_in_flight;
+    if (done.m_result < 0) {
+      throw std::system_error(
+          -done.m_result,
+          std::generic_category(),
+          "write " + m_filename);
+    }
+    // regular files only have short writes when the disk is full, and the
+    // rest of the buffer then fails with ENOSPC
+    auto const written = static_cast<std::size_t>(done.m_result);
+    if (written != BUFFER_SIZE) {
+      write_all(
+          buffer(idx) + written,
+          BUFFER_SIZE - written,
+          m_offsets[idx] + written);
+    }
+  }
+
+  // writes what the current buffer holds, which is usually not a whole number
+  // of blocks, so without O_DIRECT
+  void write_current() {
+    if (m_fill == 0) {
+      return;
+    }
+    int const flags = ::fcntl(m_fd, F_GETFL);
+    if (flags < 0 || ::fcntl(m_fd, F_SETFL, flags & ~O_DIRECT) != 0) {
+      throw_errno("fcntl " + m_filename);
+    }
+    write_all(buffer(m_current), m_fill, m_offset);
+    if ((flags & O_DIRECT) != 0 && ::fcntl(m_fd, F_SETFL, flags) != 0) {
+      throw_errno("fcntl " + m_filename);
+    }
+  }
+
+  void write_buffers(std::stop_token const &stop) {
+    std::unique_lock lock(m_mutex);
+    while (m_cv.wait(lock, stop, [this] { return !m_queue.empty(); })) {
+      std::size_t const idx = m_queue.front();
+      m_queue.pop_front();
+      std::uint64_t const offset = m_offsets[idx];
+      lock.unlock();
+      int const err = write_fully(buffer(idx), BUFFER_SIZE, offset);
+      lock.lock();
+      m_done.push_back({idx, err == 0 ? static_cast<int>(BUFFER_SIZE) : -err});
+      m_cv.notify_all();
+    }
+  }
+
+  // writes all of `data` at `offset`, or at the end of a pipe, and returns 0
+  // or the error
+  int write_fully(char const *data, std::size_t size, std::uint64_t offset) {
+    while (size != 0) {
+      ssize_t const written =
+          m_seekable
+              ? ::pwrite(m_fd, data, size, static_cast<off_t>(offset))
+              : ::write(m_fd, data, size);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return errno;
+      }
+      data += written;
+      size -= static_cast<std::size_t>(written);
+      offset += static_cast<std::uint64_t>(written);
+    }
+    return 0;
+  }
+
+  void write_all(char const *data, std::size_t size, std::uint64_t offset) {
+    if (int const err = write_fully(data, size, offset); err != 0) {
+      errno = err;
+      throw_errno("write " + m_filename);
+    }
+  }
+};
+
+// opens the file itself, under the compressors
+std::unique_ptr<output_sink> open_file(
+    std::string filename,
+    design_config const &config,
+    std::uint64_t resume_offset = 0) {
+  if (config.async_io) {
+    return std::make_unique<async_file_sink>(
+        std::move(filename),
+        config.direct_io,
+        resume_offset);
+  }
+  return std::make_unique<file_sink>(std::move(filename), resume_offset);
+}
+
+// counts the bytes written to the file under a compressor, i.e. the size of
+// the compressed file
+class counting_sink : public output_sink {
+public:
+  counting_sink(
+      std::unique_ptr<output_sink> file,
+      std::atomic<std::uint64_t> &bytes_written)
+      : m_file(std::move(file)),
+        m_bytes_written(bytes_written) {}
+
+  void write(char const *data, std::streamsize size) override {
+    m_file->write(data, size);
+    m_bytes_written.fetch_add(
+        static_cast<std::uint64_t>(size),
+        std::memory_order_relaxed);
+  }
+
+  void close() override {
+    m_file->close();
+  }
+
+  std::uint64_t sync() override {
+    return m_file->sync();
+  }
+
+private:
+  std::unique_ptr<output_sink> m_file;
+  std::atomic<std::uint64_t> &m_bytes_written;
+};
+
+// compresses into a gzip file with zlib, on the calling thread, as a single
+// stream
+class gzip_sink : public output_sink {
+public:
+  gzip_sink(std::unique_ptr<output_sink> file, int level)
+      : m_file(std::move(file)) {
+    // 15 bits of window, +16 for a gzip header and trailer instead of a zlib
+    // one
+    int const err = ::deflateInit2(
+        &m_stream,
+        level == 0 ? Z_DEFAULT_COMPRESSION : level,
+        Z_DEFLATED,
+        15 + 16,
+        8,
+        Z_DEFAULT_STRATEGY);
+    ASSERT(err == Z_OK, "deflateInit2 failed", err);
+  }
+
+  ~gzip_sink() override {
+    ::deflateEnd(&m_stream);
+  }
+
+  void write(char const *data, std::streamsize size) override {
+    // the sizes of zlib are 32 bits
+    while (size > 0) {
+      auto const chunk = static_cast<uInt>(
+          std::min<std::streamsize>(size, std::streamsize{1} << 30));
+      m_stream.next_in = reinterpret_cast<Bytef const *>(data);
+      m_stream.avail_in = chunk;
+      deflate(Z_NO_FLUSH);
+      data += chunk;
+      size -= chunk;
+    }
+  }
+
+  void close() override {
+    deflate(Z_FINISH);
+    m_file->close();
+  }
+
+  std::uint64_t sync() override {
+    UNREACHABLE("compressed files can't be synced");
+  }
+
+private:
+  std::unique_ptr<output_sink> m_file;
+  z_stream m_stream{};
+  std::array<char, COMPRESSED_BUF_SIZE> m_buf{};
+
+  // compresses all the input, and, with `Z_FINISH`, ends the stream
+  void deflate(int flush) {
+    // as long as zlib fills the whole buffer, it may have more to write
+    do {
+      m_stream.next_out = reinterpret_cast<Bytef *>(m_buf.data());
+      m_stream.avail_out = static_cast<uInt>(m_buf.size());
+      int const err = ::deflate(&m_stream, flush);
+      ASSERT(err != Z_STREAM_ERROR, "deflate failed");
+      m_file->write(
+          m_buf.data(),
+          static_cast<std::streamsize>(m_buf.size() - m_stream.avail_out));
+    } while (m_stream.avail_out == 0);
+  }
+};
+
+// Compresses into a gzip file on a pool of threads, like pigz. The input is
+// cut in blocks of `BLOCK_SIZE` bytes, which are compressed independently,
+// each into a complete gzip member. A gzip file may be made of several
+// members, which decompress to the concatenation of their contents, so any
+// gzip reader reads the result, while a member costs only ~20 bytes and the
+// compression ratio barely suffers from the blocks.
+class parallel_gzip_sink : public output_sink {
+public:
+  static constexpr std::size_t BLOCK_SIZE{std::size_t{1} << 20};
+
+  parallel_gzip_sink(
+      std::unique_ptr<output_sink> file,
+      int level,
+      std::size_t num_threads)
+      : m_file(std::move(file)),
+        m_level(level == 0 ? Z_DEFAULT_COMPRESSION : level),
+        m_max_blocks(2 * num_threads) {
+    m_block.reserve(BLOCK_SIZE);
+    for (std::size_t thread_idx = 0; thread_idx < num_threads; ++thread_idx) {
+      m_workers.emplace_back(
+          [this](std::stop_token const &stop) { compress_blocks(stop); });
+    }
+  }
+
+  void write(char const *data, std::streamsize size) override {
+    auto remaining = static_cast<std::size_t>(size);
+    while (remaining != 0) {
+      std::size_t const chunk =
+          std::min(remaining, BLOCK_SIZE - m_block.size());
+      m_block.append(data, chunk);
+      data += chunk;
+      remaining -= chunk;
+      if (m_block.size() == BLOCK_SIZE) {
+        submit_block();
+      }
+    }
+  }
+
+  void close() override {
+    if (!m_block.empty()) {
+      submit_block();
+    }
+    std::unique_lock lock(m_mutex);
+    while (!m_blocks.empty()) {
+      write_first_block(lock);
+    }
+    lock.unlock();
+    m_file->close();
+  }
+
+  std::uint64_t sync() override {
+    UNREACHABLE("compressed files can't be synced");
+  }
+
+private:
+  class block {
+  public:
+    std::string m_input;
+    std::string m_output;
+    bool m_done{};
+  };
+
+  std::unique_ptr<output_sink> m_file;
+  int m_level;
+  // the number of blocks in memory, being filled or compressed or written,
+  // after which `write` waits for the first one
+  std::size_t m_max_blocks;
+  std::string m_block;
+
+  std::mutex m_mutex;
+  std::condition_variable_any m_cv;
+  // in the order of the file, waiting to be compressed or written
+  std::deque<std::shared_ptr<block>> m_blocks;
+  // the blocks no worker took yet
+  std::deque<std::shared_ptr<block>> m_queue;
+  // stopped and joined first when destroyed
+  std::vector<std::jthread> m_workers;
+
+  void submit_block() {
+    auto next = std::make_shared<block>();
+    next->m_input = std::exchange(m_block, {});
+    m_block.reserve(BLOCK_SIZE);
+
+    std::unique_lock lock(m_mutex);
+    m_blocks.push_back(next);
+    m_queue.push_back(std::move(next));
+    m_cv.notify_all();
+    // writes out what is ready, and waits when too much is in memory
+    while (!m_blocks.empty()
+           && (m_blocks.front()->m_done || m_blocks.size() >= m_max_blocks)) {
+      write_first_block(lock);
+    }
+  }
+
+  // waits for the first block to be compressed and writes it, without holding
+  // the lock while writing
+  void write_first_block(std::unique_lock<std::mutex> &lock) {
+    m_cv.wait(lock, [this] { return m_blocks.front()->m_done; });
+    std::shared_ptr<block> const first = std::move(m_blocks.front());
+    m_blocks.pop_front();
+    lock.unlock();
+    m_file->write(
+        first->m_output.data(),
+        static_cast<std::streamsize>(first->m_output.size()));
+    lock.lock();
+  }
+
+  void compress_blocks(std::stop_token const &stop) {
+    z_stream stream{};
+    // 15 bits of window, +16 for a gzip header and trailer
+    int const err = ::deflateInit2(
+        &stream,
+        m_level,
+        Z_DEFLATED,
+        15 + 16,
+        8,
+        Z_DEFAULT_STRATEGY);
+    ASSERT(err == Z_OK, "deflateInit2 failed", err);
+
+    std::unique_lock lock(m_mutex);
+    while (m_cv.wait(lock, stop, [this] { return !m_queue.empty(); })) {
+      std::shared_ptr<block> const next = std::move(m_queue.front());
+      m_queue.pop_front();
+      lock.unlock();
+      compress_block(stream, *next);
+      lock.lock();
+      next->m_done = true;
+      m_cv.notify_all();
+    }
+    ::deflateEnd(&stream);
+  }
+
+  static void compress_block(z_stream &stream, block &b) {
+    ::deflateReset(&stream);
+    b.m_output.resize(::deflateBound(&stream, b.m_input.size()));
+    stream.next_in = reinterpret_cast<Bytef const *>(b.m_input.data());
+    stream.avail_in = static_cast<uInt>(b.m_input.size());
+    stream.next_out = reinterpret_cast<Bytef *>(b.m_output.data());
+    stream.avail_out = static_cast<uInt>(b.m_output.size());
+    // the bound guarantees a single call
+    int const err = ::deflate(&stream, Z_FINISH);
+    ASSERT(err == Z_STREAM_END, "deflate failed", err);
+    b.m_output.resize(b.m_output.size() - stream.avail_out);
+    b.m_input = {};
+  }
+};
+
+// compresses into a zstd file with libzstd, which compresses in its own
+// worker threads when it has more than one
+class zstd_sink : public output_sink {
+public:
+  zstd_sink(
+      std::unique_ptr<output_sink> file,
+      int level,
+      std::size_t num_threads)
+      : m_file(std::move(file)),
+        m_ctx(::ZSTD_createCCtx()) {
+    ASSERT(m_ctx != nullptr, "ZSTD_createCCtx failed");
+    check(::ZSTD_CCtx_setParameter(
+        m_ctx,
+        ZSTD_c_compressionLevel,
+        level == 0 ? ZSTD_CLEVEL_DEFAULT : level));
+    // fails when libzstd was built without threads, and then it compresses
+    // on the calling thread
+    if (num_threads > 1) {
+      ::ZSTD_CCtx_setParameter(
+          m_ctx,
+          ZSTD_c_nbWorkers,
+          static_cast<int>(num_threads));
+    }
+  }
+
+  ~zstd_sink() override {
+    ::ZSTD_freeCCtx(m_ctx);
+  }
+
+  void write(char const *data, std::streamsize size) override {
+    ZSTD_inBuffer input{data, static_cast<std::size_t>(size), 0};
+    while (input.pos != input.size) {
+      compress(input, ZSTD_e_continue);
+    }
+  }
+
+  void close() override {
+    ZSTD_inBuffer input{nullptr, 0, 0};
+    while (compress(input, ZSTD_e_end) != 0) {
+    }
+    m_file->close();
+  }
+
+  std::uint64_t sync() override {
+    UNREACHABLE("compressed files can't be synced");
+  }
+
+private:
+  std::unique_ptr<output_sink> m_file;
+  ZSTD_CCtx *m_ctx;
+  std::array<char, COMPRESSED_BUF_SIZE> m_buf{};
+
+  static std::size_t check(std::size_t ret) {
+    ASSERT(!::ZSTD_isError(ret), ::ZSTD_getErrorName(ret));
+    return ret;
+  }
+
+  // returns how much the compressor still holds
+  std::size_t compress(ZSTD_inBuffer &input, ZSTD_EndDirective end) {
+    ZSTD_outBuffer output{m_buf.data(), m_buf.size(), 0};
+    std::size_t const remaining =
+        check(::ZSTD_compressStream2(m_ctx, &output, &input, end));
+    m_file->write(m_buf.data(), static_cast<std::streamsize>(output.pos));
+    return remaining;
+  }
+};
+} // namespace
+
+std::pair<int, int> compress_level_range(output_codec codec) {
+  switch (codec) {
+  case output_codec::NONE:
+    // no levels
+    return {0, 0};
+  case output_codec::GZIP:
+    return {Z_BEST_SPEED, Z_BEST_COMPRESSION};
+  case output_codec::ZSTD:
+    return {::ZSTD_minCLevel(), ::ZSTD_maxCLevel()};
+  }
+  UNREACHABLE();
+}
+
+std::string
+output_file_name(std::string const &name, design_config const &config) {
+  switch (config.codec) {
+  case output_codec::NONE:
+    return name;
+  case output_codec::GZIP:
+    return name + ".gz";
+  case output_codec::ZSTD:
+    return name + ".zst";
+  }
+  UNREACHABLE();
+}
+
+std::string output_path(
+    std::string const &path,
+    std::string const &name,
+    design_config const &config) {
+  return path.empty() ? output_file_name(name, config) : path;
+}
+
+void unlink_shared_file(std::string const &path) {
+  struct stat st{};
+  if (::lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)
+      && st.st_nlink > 1 && ::unlink(path.c_str()) != 0) {
+    throw_errno("unlink " + path);
+  }
+}
+
+bool seekable_output(std::string const &path) {
+  if (path == "-") {
+    return false;
+  }
+  struct stat st{};
+  if (::stat(path.c_str(), &st) != 0) {
+    // created as a regular file
+    return errno == ENOENT;
+  }
+  return S_ISREG(st.st_mode);
+}
+
+std::unique_ptr<output_sink> open_output_sink(
+    std::string const &path,
+    design_config const &config,
+    std::uint64_t resume_offset,
+    std::atomic<std::uint64_t> *compressed_bytes) {
+  // the offsets are those of the uncompressed file
+  ASSERT(resume_offset == 0 || config.codec == output_codec::NONE);
+  std::unique_ptr<output_sink> file = open_file(path, config, resume_offset);
+  if (compressed_bytes != nullptr && config.codec != output_codec::NONE) {
+    file = std::make_unique<counting_sink>(std::move(file), *compressed_bytes);
+  }
+  switch (config.codec) {
+  case output_codec::NONE:
+    return file;
+  case output_codec::GZIP:
+    if (config.compress_threads > 1) {
+      return std::make_unique<parallel_gzip_sink>(
+          std::move(file),
+          config.compress_level,
+          config.compress_threads);
+    }
+    return std::make_unique<gzip_sink>(std::move(file), config.compress_level);
+  case output_codec::ZSTD:
+    return std::make_unique<zstd_sink>(
+        std::move(file),
+        config.compress_level,
+        config.compress_threads);
+  }
+  UNREACHABLE();
+}
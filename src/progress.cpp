@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fmt/os.h>
+#include <libassert/assert.hpp>
+#include <string>
+#include <utility>
+
+#include "progress.hpp"
+
+namespace {
+constexpr double BYTES_PER_MB{1e6};
+
+double to_mb(std::uint64_t bytes) {
+  return static_cast<double>(bytes) / BYTES_PER_MB;
+}
+
+double percent(std::uint64_t count, std::uint64_t total) {
+  return total == 0 ? 100
+                    : 100 * static_cast<double>(count)
+                          / static_cast<double>(total);
+}
+} // namespace
+
+progress_reporter::progress_reporter(
+    std::vector<file_progress const *> files,
+    std::chrono::milliseconds interval,
+    std::string status_path,
+    std::chrono::milliseconds status_interval)
+    : m_files(std::move(files)),
+      m_snapshots(m_files.size()),
+      m_interval(interval),
+      m_status_path(std::move(status_path)),
+      m_status_interval(status_interval),
+      m_start(std::chrono::steady_clock::now()),
+      m_last_report(m_start) {
+  ASSERT(m_status_path.empty() || m_status_interval.count() > 0);
+  if (m_interval.count() > 0 || !m_status_path.empty()) {
+    m_thread = std::jthread([this](std::stop_token const &stop) { run(stop); });
+  }
+}
+
+progress_reporter::~progress_reporter() {
+  if (m_thread.joinable()) {
+    m_thread.request_stop();
+    m_thread.join();
+  }
+  // the final status, if the run was long enough to print any
+  report(m_printed, !m_status_path.empty());
+}
+
+// The status lines and the status file have deadlines of their own, and the
+// thread wakes up at the earlier one.
+void progress_reporter::run(std::stop_token const &stop) {
+  bool const print = m_interval.count() > 0;
+  bool const write_status = !m_status_path.empty();
+  auto next_print = print ? m_start + m_interval
+                          : std::chrono::steady_clock::time_point::max();
+  auto next_status = write_status
+                         ? m_start + m_status_interval
+                         : std::chrono::steady_clock::time_point::max();
+  std::unique_lock lock(m_mutex);
+  while (!stop.stop_requested()) {
+    // only wakes up early to stop
+    m_cv.wait_until(
+        lock, stop, std::min(next_print, next_status), [] { return false; });
+    if (stop.stop_requested()) {
+      break;
+    }
+    auto const now = std::chrono::steady_clock::now();
+    bool const print_due = now >= next_print;
+    bool const status_due = now >= next_status;
+    if (print_due) {
+      next_print += m_interval;
+    }
+    if (status_due) {
+      next_status += m_status_interval;
+    }
+    if (print_due || status_due) {
+      report(print_due, status_due);
+    }
+  }
+}
+
+void progress_reporter::report(bool print, bool write_status) {
+  auto const now = std::chrono::steady_clock::now();
+  double const elapsed_sec =
+      std::chrono::duration<double>(now - m_start).count();
+  double const period_sec =
+      std::chrono::duration<double>(now - m_last_report).count();
+  m_last_report = now;
+
+  for (std::size_t file_idx = 0; file_idx < m_files.size(); ++file_idx) {
+    file_progress const &file = *m_files[file_idx];
+    file_snapshot &snapshot = m_snapshots[file_idx];
+    std::uint64_t const nets_written =
+        file.m_nets_written.load(std::memory_order_relaxed);
+    std::uint64_t const bytes_written =
+        file.m_bytes_written.load(std::memory_order_relaxed);
+    if (period_sec > 0) {
+      snapshot.m_nets_per_sec =
+          static_cast<double>(nets_written - snapshot.m_nets_written)
+          / period_sec;
+      snapshot.m_mb_per_sec =
+          to_mb(bytes_written - snapshot.m_bytes_written) / period_sec;
+    }
+    snapshot.m_nets_written = nets_written;
+    snapshot.m_bytes_written = bytes_written;
+  }
+
+  if (print) {
+    print_status(elapsed_sec);
+    m_printed = true;
+  }
+  if (write_status) {
+    // the file is only there to follow the run, so a failure to write it, e.g.
+    // on a full disk, doesn't stop the run
+    try {
+      write_status_file(elapsed_sec);
+    } catch (std::exception const &e) {
+      fmt::println(
+          stderr,
+          "warning: can't write the status file {}: {}",
+          m_status_path,
+          e.what());
+    }
+  }
+}
+
+// e.g.
+//   [12s] block.v: done, 14.9 MB | block.spef: 4512/100000 nets (4.5%), 8192
+//   generated, 1.5 MB, 3760 nets/s, 1.2 MB/s | ...
+void progress_reporter::print_status(double elapsed_sec) const {
+  fmt::memory_buffer line;
+  auto out = std::back_inserter(line);
+  fmt::format_to(out, "[{:.0f}s]", elapsed_sec);
+  for (std::size_t file_idx = 0; file_idx < m_files.size(); ++file_idx) {
+    file_progress const &file = *m_files[file_idx];
+    file_snapshot const &snapshot = m_snapshots[file_idx];
+    fmt::format_to(out, "{} {}: ", file_idx == 0 ? "" : " |", file.m_name);
+    if (file.m_done.load(std::memory_order_relaxed)) {
+      fmt::format_to(out, "done, {:.1f} MB", to_mb(snapshot.m_bytes_written));
+      if (file.m_compressed) {
+        fmt::format_to(
+            out,
+            " ({:.1f} MB compressed)",
+            to_mb(file.m_compressed_bytes.load(std::memory_order_relaxed)));
+      }
+    } else if (file.m_total_nets != 0) {
+      fmt::format_to(
+          out,
+          "{}/{} nets ({:.1f}%), {} generated, {:.1f} MB, {:.0f} nets/s, "
+          "{:.1f} MB/s",
+          snapshot.m_nets_written,
+          file.m_total_nets,
+          percent(snapshot.m_nets_written, file.m_total_nets),
+          file.m_nets_generated.load(std::memory_order_relaxed),
+          to_mb(snapshot.m_bytes_written),
+          snapshot.m_nets_per_sec,
+          snapshot.m_mb_per_sec);
+    } else {
+      fmt::format_to(
+          out,
+          "{:.1f}/{:.1f} MB ({:.1f}%), {:.1f} MB/s",
+          to_mb(snapshot.m_bytes_written),
+          to_mb(file.m_total_bytes),
+          percent(snapshot.m_bytes_written, file.m_total_bytes),
+          snapshot.m_mb_per_sec);
+    }
+  }
+  fmt::println(stderr, "{}", fmt::string_view(line.data(), line.size()));
+}
+
+// Writes the status next to the status file first, and then renames it, so
+// that readers never see a partial file.
+void progress_reporter::write_status_file(double elapsed_sec) const {
+  std::string const tmp_path = m_status_path + ".tmp";
+  {
+    auto file = fmt::output_file(tmp_path);
+    file.print("{{\n  \"elapsed_sec\": {:.3f},\n  \"files\": [", elapsed_sec);
+    for (std::size_t file_idx = 0; file_idx < m_files.size(); ++file_idx) {
+      file_progress const &progress = *m_files[file_idx];
+      file_snapshot const &snapshot = m_snapshots[file_idx];
+      file.print(
+          "{}\n    {{\"name\": {:?}, \"done\": {}, \"total_nets\": {}, "
+          "\"nets_generated\": {}, \"nets_written\": {}, \"total_bytes\": {}, "
+          "\"bytes_written\": {}, \"nets_per_sec\": {:.1f}, "
+          "\"mb_per_sec\": {:.3f}",
+          file_idx == 0 ? "" : ",",
+          progress.m_name,
+          progress.m_done.load(std::memory_order_relaxed),
+          progress.m_total_nets,
+          progress.m_nets_generated.load(std::memory_order_relaxed),
+          snapshot.m_nets_written,
+          progress.m_total_bytes,
+          snapshot.m_bytes_written,
+          snapshot.m_nets_per_sec,
+          snapshot.m_mb_per_sec);
+      // the bytes above are those of the content
+      if (progress.m_compressed) {
+        file.print(
+            ", \"compressed_bytes\": {}",
+            progress.m_compressed_bytes.load(std::memory_order_relaxed));
+      }
+      file.print("}}");
+    }
+    file.print("\n  ]\n}}\n");
+  }
+  std::filesystem::rename(tmp_path, m_status_path);
+}
@@ -0,0 +1,199 @@
+#include <ctime>
+#include <fmt/format.h>
+#include <fmt/os.h>
+#include <fstream>
+#include <libassert/assert.hpp>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <utility>
+
+#include "run_stats.hpp"
+
+namespace {
+double timespec_sec(timespec const &ts) {
+  return static_cast<double>(ts.tv_sec)
+         + static_cast<double>(ts.tv_nsec) * 1e-9;
+}
+
+double cpu_sec(clockid_t clock) {
+  timespec ts{};
+  ::clock_gettime(clock, &ts);
+  return timespec_sec(ts);
+}
+
+std::string_view rng_name(rng_mode rng) {
+  switch (rng) {
+  case rng_mode::SEQUENTIAL:
+    return "sequential";
+  case rng_mode::COUNTER:
+    return "counter";
+  }
+  UNREACHABLE();
+}
+
+std::string_view codec_name(output_codec codec) {
+  switch (codec) {
+  case output_codec::NONE:
+    return "none";
+  case output_codec::GZIP:
+    return "gzip";
+  case output_codec::ZSTD:
+    return "zstd";
+  }
+  UNREACHABLE();
+}
+} // namespace
+
+double thread_cpu_sec() {
+  return cpu_sec(CLOCK_THREAD_CPUTIME_ID);
+}
+
+double process_cpu_sec() {
+  return cpu_sec(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+// from the second field of /proc/self/statm, in pages, or 0 where it doesn't
+// exist
+std::uint64_t current_rss_bytes() {
+  std::ifstream statm("/proc/self/statm");
+  std::uint64_t size_pages = 0;
+  std::uint64_t rss_pages = 0;
+  if (!(statm >> size_pages >> rss_pages)) {
+    return 0;
+  }
+  return rss_pages * static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+}
+
+std::uint64_t peak_rss_bytes() {
+  rusage usage{};
+  ::getrusage(RUSAGE_SELF, &usage);
+  // in KiB on Linux
+  return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+run_stats::run_stats() : m_start(std::chrono::steady_clock::now()) {}
+
+void run_stats::add(phase p) {
+  std::lock_guard const lock(m_mutex);
+  m_phases.push_back(std::move(p));
+}
+
+void run_stats::write(
+    std::string const &path,
+    design_config const &config,
+    std::vector<file_progress const *> const &files) const {
+  double const wall_sec = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - m_start)
+                              .count();
+  auto out = fmt::output_file(path);
+  out.print("{{\n");
+  out.print("  \"seed\": {},\n", config.seed);
+  out.print("  \"config\": {{\n");
+  out.print("    \"num_nets\": {},\n", config.num_nets);
+  out.print("    \"num_blocks\": {},\n", config.num_blocks);
+  out.print("    \"num_ccaps\": {},\n", config.min_num_ccaps);
+  out.print("    \"num_threads\": {},\n", config.num_threads);
+  out.print("    \"num_cols\": {},\n", config.num_cols);
+  out.print("    \"rng\": \"{}\",\n", rng_name(config.rng));
+  out.print("    \"stream_spef\": {},\n", config.stream_spef);
+  out.print("    \"name_map\": {},\n", config.name_map);
+  out.print("    \"quantize_caps\": {},\n", config.quantize_caps);
+  out.print("    \"spef_shards\": {},\n", config.spef_shards);
+  out.print("    \"compress\": \"{}\",\n", codec_name(config.codec));
+  out.print("    \"compress_level\": {},\n", config.compress_level);
+  out.print("    \"compress_threads\": {},\n", config.compress_threads);
+  out.print("    \"async_io\": {},\n", config.async_io);
+  out.print("    \"direct_io\": {},\n", config.direct_io);
+  out.print(
+      "    \"checkpoint_interval\": {},\n",
+      config.checkpoint_interval.count());
+  out.print("    \"resume\": {},\n", config.resume);
+  out.print("    \"cache_dir\": {:?},\n", config.cache_dir);
+  out.print("    \"min_cap_val\": {},\n", config.min_cap_val);
+  out.print("    \"max_cap_val\": {},\n", config.max_cap_val);
+  out.print("    \"block_name\": {:?},\n", config.block_name);
+  out.print("    \"top_name\": {:?},\n", config.top_name);
+  out.print("    \"block_prefix\": {:?},\n", config.block_prefix);
+  out.print("    \"cell_prefix\": {:?},\n", config.cell_prefix);
+  out.print("    \"net_prefix\": {:?},\n", config.net_prefix);
+  out.print("    \"lib_cell_name\": {:?},\n", config.lib_cell_name);
+  out.print("    \"lib_cell_inp_pin\": {:?},\n", config.lib_cell_inp_pin);
+  out.print("    \"lib_cell_out_pin\": {:?},\n", config.lib_cell_out_pin);
+  out.print("    \"lib_leaf_cell_name\": {:?},\n", config.lib_leaf_cell_name);
+  out.print(
+      "    \"lib_leaf_cell_d_pin\": {:?}\n",
+      config.lib_leaf_cell_d_pin);
+  out.print("  }},\n");
+
+  out.print("  \"wall_sec\": {:.3f},\n", wall_sec);
+  out.print("  \"cpu_sec\": {:.3f},\n", process_cpu_sec());
+  out.print("  \"peak_rss_bytes\": {},\n", peak_rss_bytes());
+
+  out.print("  \"files\": [");
+  for (std::size_t file_idx = 0; file_idx < files.size(); ++file_idx) {
+    file_progress const &file = *files[file_idx];
+    // the size on the disk, and that of the content of a compressed file
+    if (file.m_compressed) {
+      out.print(
+          "{}\n    {{\"name\": {:?}, \"bytes\": {}, "
+          "\"uncompressed_bytes\": {}}}",
+          file_idx == 0 ? "" : ",",
+          file.m_name,
+          file.m_compressed_bytes.load(),
+          file.m_bytes_written.load());
+    } else {
+      out.print(
+          "{}\n    {{\"name\": {:?}, \"bytes\": {}}}",
+          file_idx == 0 ? "" : ",",
+          file.m_name,
+          file.m_bytes_written.load());
+    }
+  }
+  out.print("\n  ],\n");
+
+  std::lock_guard const lock(m_mutex);
+  out.print("  \"phases\": [");
+  for (std::size_t phase_idx = 0; phase_idx < m_phases.size(); ++phase_idx) {
+    phase const &p = m_phases[phase_idx];
+    out.print(
+        "{}\n    {{\"file\": {:?}, \"phase\": {:?}, \"wall_sec\": {:.3f}, "
+        "\"thread_cpu_sec\": {:.3f}, \"process_cpu_sec\": {:.3f}, "
+        "\"rss_after_bytes\": {}}}",
+        phase_idx == 0 ? "" : ",",
+        p.m_file,
+        p.m_name,
+        p.m_wall_sec,
+        p.m_thread_cpu_sec,
+        p.m_process_cpu_sec,
+        p.m_rss_after_bytes);
+  }
+  out.print("\n  ]\n}}\n");
+}
+
+phase_timer::phase_timer(run_stats &stats, std::string file, std::string name)
+    : m_stats(stats),
+      m_file(std::move(file)),
+      m_name(std::move(name)),
+      m_wall_start(std::chrono::steady_clock::now()),
+      m_thread_cpu_start(thread_cpu_sec()),
+      m_process_cpu_start(process_cpu_sec()) {}
+
+phase_timer::~phase_timer() {
+  stop();
+}
+
+void phase_timer::stop() {
+  if (m_stopped) {
+    return;
+  }
+  m_stopped = true;
+  m_stats.add(
+      {std::move(m_file),
+       std::move(m_name),
+       std::chrono::duration<double>(
+           std::chrono::steady_clock::now() - m_wall_start)
+           .count(),
+       thread_cpu_sec() - m_thread_cpu_start,
+       process_cpu_sec() - m_process_cpu_start,
+       current_rss_bytes()});
+}
@@ -0,0 +1,205 @@
+# Runs gen_design once in an empty directory, and checks what it wrote:
+#   cmake -DGEN_DESIGN=<path> -DWORK_DIR=<dir> "-DARGS=<arg> <arg> ..."
+#         [-DDIGESTS=<file> [-DUPDATE_DIGESTS=ON]]
+#         [-DSTDOUT=<file>]
+#         [-DSHARDS=<count>]
+#         ["-DCACHE_ARGS=<arg> <arg> ..."]
+#         [-DINTERRUPT=ON]
+#         [-DEXTENSION=<ext> "-DDECOMPRESS=<command> <arg> ..."]
+#         [-DBASELINE=<file> -DTHRESHOLD_PCT=<percent> [-DUPDATE_BASELINE=ON]]
+#         -P run_case.cmake
+#
+# With STDOUT, the standard output of gen_design is kept as <file> of WORK_DIR,
+# for a run that writes one of its files to "-".
+# With SHARDS, the run writes block.spef as <count> files block.<k>.spef,
+# which are put back together, without the head of all but the first, as the
+# block.spef that is checked.
+# With CACHE_ARGS, a first run with these arguments, in another directory,
+# fills a --cache_dir, which the run with ARGS then reuses the files of.
+# With INTERRUPT, the run, whose ARGS have a --checkpoint_interval, is killed
+# after a second, and run again with --resume, each time killed twice as late,
+# until it was killed in the middle of a file, between two checkpoints. It is
+# then resumed to the end, and that is checked.
+# DIGESTS is a `sha256sum` listing of the four output files, which must match
+# byte for byte. Compressed files, which end with EXTENSION, are first
+# decompressed by DECOMPRESS, which writes the content of its last argument to
+# stdout. BASELINE holds the nets/s and the peak RSS of a reference run
+# of the same case, as `nets_per_sec <value>` and `peak_rss_bytes <value>`
+# lines, and the run fails if its nets/s drops, or its peak RSS grows, by more
+# than THRESHOLD_PCT percent. With UPDATE_DIGESTS and UPDATE_BASELINE, they are
+# rewritten from the run instead of being checked.
+
+foreach(var GEN_DESIGN WORK_DIR ARGS)
+  if(NOT DEFINED ${var})
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+separate_arguments(arg_list UNIX_COMMAND "${ARGS}")
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+if(DEFINED CACHE_ARGS)
+  separate_arguments(cache_arg_list UNIX_COMMAND "${CACHE_ARGS}")
+  file(MAKE_DIRECTORY ${WORK_DIR}/cache_fill)
+  execute_process(
+    COMMAND ${GEN_DESIGN} ${cache_arg_list} --progress_interval 0
+      --cache_dir ${WORK_DIR}/cache
+    WORKING_DIRECTORY ${WORK_DIR}/cache_fill
+    RESULT_VARIABLE result
+    OUTPUT_QUIET)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "gen_design ${CACHE_ARGS} failed: ${result}")
+  endif()
+  list(APPEND arg_list --cache_dir ${WORK_DIR}/cache)
+endif()
+if(INTERRUPT)
+  set(timeout 1)
+  set(interrupted FALSE)
+  while(NOT interrupted)
+    # a run without checkpoints starts from the beginning
+    execute_process(
+      COMMAND ${GEN_DESIGN} ${arg_list} --resume --progress_interval 0
+      WORKING_DIRECTORY ${WORK_DIR}
+      RESULT_VARIABLE result
+      OUTPUT_QUIET
+      TIMEOUT ${timeout})
+    if(result EQUAL 0)
+      message(FATAL_ERROR
+        "gen_design ${ARGS} ended before it was killed in the middle of a file")
+    elseif(NOT result MATCHES "timeout")
+      message(FATAL_ERROR "gen_design ${ARGS} --resume failed: ${result}")
+    endif()
+    file(GLOB checkpoints ${WORK_DIR}/*.checkpoint)
+    foreach(checkpoint ${checkpoints})
+      file(READ ${checkpoint} checkpoint_text)
+      if(checkpoint_text MATCHES "\ndone 0\n")
+        set(interrupted TRUE)
+      endif()
+    endforeach()
+    math(EXPR timeout "${timeout} * 2")
+  endwhile()
+  list(APPEND arg_list --resume)
+endif()
+if(DEFINED STDOUT)
+  set(output OUTPUT_FILE ${WORK_DIR}/${STDOUT})
+else()
+  set(output OUTPUT_QUIET)
+endif()
+execute_process(
+  COMMAND ${GEN_DESIGN} ${arg_list} --progress_interval 0 --stats stats.json
+  WORKING_DIRECTORY ${WORK_DIR}
+  RESULT_VARIABLE result
+  ${output})
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "gen_design ${ARGS} failed: ${result}")
+endif()
+
+set(output_files block.v top.v block.spef top.spef)
+
+# the checkpoints of --checkpoint_interval are only left by interrupted runs
+file(GLOB checkpoints ${WORK_DIR}/*.checkpoint)
+if(checkpoints)
+  message(FATAL_ERROR "gen_design ${ARGS} left checkpoints: ${checkpoints}")
+endif()
+
+if(DEFINED DECOMPRESS)
+  separate_arguments(decompress UNIX_COMMAND "${DECOMPRESS}")
+  foreach(file ${output_files})
+    execute_process(
+      COMMAND ${decompress} ${file}${EXTENSION}
+      WORKING_DIRECTORY ${WORK_DIR}
+      RESULT_VARIABLE result
+      OUTPUT_FILE ${WORK_DIR}/${file})
+    if(NOT result EQUAL 0)
+      message(FATAL_ERROR "${DECOMPRESS} ${file}${EXTENSION} failed: ${result}")
+    endif()
+  endforeach()
+endif()
+
+if(DEFINED SHARDS)
+  if(NOT EXISTS ${WORK_DIR}/block_spef_shards.tcl)
+    message(FATAL_ERROR "gen_design ${ARGS} didn't write block_spef_shards.tcl")
+  endif()
+  file(READ ${WORK_DIR}/block.0.spef block_spef)
+  math(EXPR last_shard "${SHARDS} - 1")
+  foreach(shard RANGE 1 ${last_shard})
+    file(READ ${WORK_DIR}/block.${shard}.spef shard_spef)
+    string(FIND "${shard_spef}" "\n*D_NET " nets_pos)
+    if(NOT nets_pos EQUAL -1)
+      math(EXPR nets_pos "${nets_pos} + 1")
+      string(SUBSTRING "${shard_spef}" ${nets_pos} -1 shard_nets)
+      string(APPEND block_spef "${shard_nets}")
+    endif()
+  endforeach()
+  file(WRITE ${WORK_DIR}/block.spef "${block_spef}")
+endif()
+
+if(DEFINED DIGESTS)
+  set(digests "")
+  foreach(file ${output_files})
+    file(SHA256 ${WORK_DIR}/${file} digest)
+    string(APPEND digests "${digest}  ${file}\n")
+  endforeach()
+  if(UPDATE_DIGESTS)
+    file(WRITE ${DIGESTS} "${digests}")
+    message(STATUS "updated ${DIGESTS}")
+  else()
+    file(READ ${DIGESTS} expected_digests)
+    if(NOT digests STREQUAL expected_digests)
+      message(FATAL_ERROR
+        "the output of gen_design ${ARGS} changed\n"
+        "expected (${DIGESTS}):\n${expected_digests}"
+        "got (${WORK_DIR}):\n${digests}")
+    endif()
+  endif()
+endif()
+
+if(DEFINED BASELINE)
+  file(READ ${WORK_DIR}/stats.json stats)
+  string(REGEX MATCH "\"num_nets\": ([0-9]+)" _ "${stats}")
+  set(num_nets ${CMAKE_MATCH_1})
+  string(REGEX MATCH "\"num_blocks\": ([0-9]+)" _ "${stats}")
+  set(num_blocks ${CMAKE_MATCH_1})
+  string(REGEX MATCH "\"wall_sec\": ([0-9.]+)" _ "${stats}")
+  set(wall_sec ${CMAKE_MATCH_1})
+  string(REGEX MATCH "\"peak_rss_bytes\": ([0-9]+)" _ "${stats}")
+  set(peak_rss_bytes ${CMAKE_MATCH_1})
+
+  # `math` only does integers, so the wall time is taken in milliseconds
+  string(REPLACE "." "" wall_ms ${wall_sec})
+  math(EXPR wall_ms "${wall_ms} + 0")
+  if(wall_ms EQUAL 0)
+    set(wall_ms 1)
+  endif()
+  # the nets of the block and the top SPEF files
+  math(EXPR nets_per_sec "(${num_nets} + ${num_blocks}) * 1000 / ${wall_ms}")
+
+  if(UPDATE_BASELINE)
+    file(WRITE ${BASELINE}
+      "nets_per_sec ${nets_per_sec}\npeak_rss_bytes ${peak_rss_bytes}\n")
+    message(STATUS "updated ${BASELINE}")
+    return()
+  endif()
+
+  file(READ ${BASELINE} baseline)
+  string(REGEX MATCH "nets_per_sec ([0-9]+)" _ "${baseline}")
+  set(baseline_nets_per_sec ${CMAKE_MATCH_1})
+  string(REGEX MATCH "peak_rss_bytes ([0-9]+)" _ "${baseline}")
+  set(baseline_peak_rss_bytes ${CMAKE_MATCH_1})
+
+  math(EXPR min_nets_per_sec
+    "${baseline_nets_per_sec} * (100 - ${THRESHOLD_PCT}) / 100")
+  math(EXPR max_peak_rss_bytes
+    "${baseline_peak_rss_bytes} * (100 + ${THRESHOLD_PCT}) / 100")
+
+  message(STATUS
+    "${nets_per_sec} nets/s (baseline ${baseline_nets_per_sec}, at least "
+    "${min_nets_per_sec}), peak RSS ${peak_rss_bytes} bytes (baseline "
+    "${baseline_peak_rss_bytes}, at most ${max_peak_rss_bytes})")
+  if(nets_per_sec LESS min_nets_per_sec)
+    message(FATAL_ERROR "gen_design ${ARGS} is slower than its baseline")
+  endif()
+  if(peak_rss_bytes GREATER max_peak_rss_bytes)
+    message(FATAL_ERROR "gen_design ${ARGS} uses more memory than its baseline")
+  endif()
+endif()
@@ -0,0 +1,48 @@
+# Runs gen_design with a --status_file, and checks that the file is written
+# while the run is going, and not only at its end:
+#   cmake -DGEN_DESIGN=<path> -DWORK_DIR=<dir> "-DARGS=<arg> <arg> ..."
+#         -P status_case.cmake
+#
+# The run must last longer than its --status_interval. The script runs itself
+# again, with POLL_FILE, next to gen_design, at the head of a pipeline whose
+# output gen_design ignores, to poll the file until it first appears, when
+# some of the files must not be done yet.
+
+if(DEFINED POLL_FILE)
+  while(NOT EXISTS ${POLL_FILE})
+    execute_process(COMMAND ${CMAKE_COMMAND} -E sleep 0.1)
+  endwhile()
+  file(READ ${POLL_FILE} status)
+  # written at the end, when everything is done
+  if(NOT status MATCHES "\"done\": false")
+    message(FATAL_ERROR "${POLL_FILE} was only written at the end:\n${status}")
+  endif()
+  return()
+endif()
+
+foreach(var GEN_DESIGN WORK_DIR ARGS)
+  if(NOT DEFINED ${var})
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+separate_arguments(arg_list UNIX_COMMAND "${ARGS}")
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+execute_process(
+  COMMAND ${CMAKE_COMMAND} -DPOLL_FILE=${WORK_DIR}/status.json
+    -P ${CMAKE_CURRENT_LIST_FILE}
+  COMMAND ${GEN_DESIGN} ${arg_list} --progress_interval 0
+    --status_file status.json
+  WORKING_DIRECTORY ${WORK_DIR}
+  RESULTS_VARIABLE results
+  OUTPUT_QUIET)
+if(NOT results STREQUAL "0;0")
+  message(FATAL_ERROR "gen_design ${ARGS} failed: ${results}")
+endif()
+
+# the final status
+file(READ ${WORK_DIR}/status.json status)
+if(status MATCHES "\"done\": false")
+  message(FATAL_ERROR "status.json isn't final:\n${status}")
+endif()